@@ -0,0 +1,692 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Interface Stub Generator
+ *
+ * This reads a description of interfaces and generates typed C stubs for them,
+ * so neither callers nor implementations of an interface have to marshal
+ * arguments by hand. The description has one declaration per line, and '#'
+ * starts a comment:
+ *
+ *         interface <name> <prefix>
+ *         member <name> <input-signature> <output-signature>
+ *
+ * Members belong to the interface declared last. Signatures are a single
+ * complete type, made up of basic types and structures. For every member
+ * <Name>, with <m> being the name in lower case with underscores, this
+ * generates:
+ *
+ *         <prefix>_<m>_call()          send a call to a handle
+ *         <prefix>_<m>_write()         write the input arguments
+ *         <prefix>_<m>_read()          read the input arguments
+ *         <prefix>_<m>_reply()         send a reply to a call
+ *         <prefix>_<m>_write_reply()   write the output arguments
+ *         <prefix>_<m>_read_reply()    read the output arguments
+ *
+ * and for every interface <prefix>_interface_new(), which creates the
+ * interface with all its members. Calls are dispatched to <prefix>_<m>(),
+ * which must be provided by the implementation and gets the decoded input
+ * arguments passed.
+ *
+ * If a signature is of fixed size, it is written as a single structure whose
+ * layout matches the serialization, rather than via b1_message_write(). The
+ * layout is verified at compile time.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct StubgenMember {
+        char *name;
+        char *cname;
+        char *input;
+        char *output;
+} StubgenMember;
+
+typedef struct StubgenInterface {
+        char *name;
+        char *prefix;
+        StubgenMember *members;
+        size_t n_members;
+} StubgenInterface;
+
+typedef struct Stubgen {
+        const char *path;
+        unsigned int line;
+        StubgenInterface *interfaces;
+        size_t n_interfaces;
+} Stubgen;
+
+static int stubgen_error(Stubgen *stubgen, const char *format, ...) {
+        va_list args;
+
+        fprintf(stderr, "%s:%u: ", stubgen->path, stubgen->line);
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        fprintf(stderr, "\n");
+
+        return -EINVAL;
+}
+
+static const char *stubgen_ctype(char c) {
+        switch (c) {
+        case 'y':
+                return "uint8_t";
+        case 'b':
+                return "bool";
+        case 'n':
+                return "int16_t";
+        case 'q':
+                return "uint16_t";
+        case 'i':
+                return "int32_t";
+        case 'u':
+                return "uint32_t";
+        case 'x':
+                return "int64_t";
+        case 't':
+                return "uint64_t";
+        case 'd':
+                return "double";
+        case 's':
+        case 'o':
+        case 'g':
+                return "const char *";
+        default:
+                return NULL;
+        }
+}
+
+static bool stubgen_is_pointer(char c) {
+        return c == 's' || c == 'o' || c == 'g';
+}
+
+/* size of a basic type in its serialized form, or 0 if not of fixed size */
+static size_t stubgen_size(char c) {
+        switch (c) {
+        case 'y':
+        case 'b':
+                return 1;
+        case 'n':
+        case 'q':
+                return 2;
+        case 'i':
+        case 'u':
+                return 4;
+        case 'x':
+        case 't':
+        case 'd':
+                return 8;
+        default:
+                return 0;
+        }
+}
+
+/* length of the complete type at the start of @signature, or 0 if invalid */
+static size_t stubgen_type_len(const char *signature) {
+        size_t n = 1, k;
+
+        if (stubgen_ctype(signature[0]))
+                return 1;
+        else if (signature[0] != '(')
+                return 0;
+
+        while (signature[n] != ')') {
+                k = stubgen_type_len(signature + n);
+                if (!k)
+                        return 0;
+                n += k;
+        }
+
+        return n + 1;
+}
+
+static bool stubgen_signature_is_valid(const char *signature) {
+        size_t n;
+
+        n = stubgen_type_len(signature);
+        return n > 0 && !signature[n];
+}
+
+/*
+ * Compute size and alignment of the complete type at *@signaturep, if it is of
+ * fixed size, and advance past it. Empty structures are not treated as fixed,
+ * as they serialize to a single byte, but have no C equivalent.
+ */
+static bool stubgen_layout(const char **signaturep, size_t *sizep, size_t *alignp) {
+        size_t size = 0, align = 1, child_size, child_align;
+        char c = *(*signaturep)++;
+
+        if (c != '(') {
+                *sizep = *alignp = stubgen_size(c);
+                return *sizep > 0;
+        }
+
+        while (**signaturep != ')') {
+                if (!stubgen_layout(signaturep, &child_size, &child_align))
+                        return false;
+
+                size = (size + child_align - 1) / child_align * child_align + child_size;
+                if (child_align > align)
+                        align = child_align;
+        }
+
+        ++*signaturep;
+
+        if (!size)
+                return false;
+
+        *sizep = (size + align - 1) / align * align;
+        *alignp = align;
+        return true;
+}
+
+static bool stubgen_is_fixed(const char *signature, size_t *sizep) {
+        size_t align;
+
+        return stubgen_layout(&signature, sizep, &align);
+}
+
+/* the signature to create messages with, the empty structure is left out */
+static const char *stubgen_message_signature(const char *signature) {
+        return strcmp(signature, "()") ? signature : "";
+}
+
+static char *stubgen_cname(const char *name) {
+        char *cname, *p;
+
+        cname = p = malloc(strlen(name) * 2 + 1);
+        if (!cname)
+                return NULL;
+
+        for (const char *s = name; *s; ++s) {
+                if (isupper((unsigned char)*s)) {
+                        if (s != name)
+                                *p++ = '_';
+                        *p++ = tolower((unsigned char)*s);
+                } else {
+                        *p++ = *s;
+                }
+        }
+
+        *p = 0;
+        return cname;
+}
+
+static int stubgen_parse_line(Stubgen *stubgen, char *line) {
+        StubgenInterface *interface;
+        StubgenMember *member;
+        char *words[4];
+        size_t n_words = 0;
+        char *word, *state;
+        void *p;
+
+        line[strcspn(line, "#\n")] = 0;
+
+        for (word = strtok_r(line, " \t", &state); word; word = strtok_r(NULL, " \t", &state)) {
+                if (n_words >= 4)
+                        return stubgen_error(stubgen, "too many words");
+                words[n_words++] = word;
+        }
+
+        if (!n_words)
+                return 0;
+
+        if (!strcmp(words[0], "interface")) {
+                if (n_words != 3)
+                        return stubgen_error(stubgen, "expected: interface <name> <prefix>");
+
+                p = realloc(stubgen->interfaces, (stubgen->n_interfaces + 1) * sizeof(*stubgen->interfaces));
+                if (!p)
+                        return -ENOMEM;
+                stubgen->interfaces = p;
+
+                interface = &stubgen->interfaces[stubgen->n_interfaces++];
+                *interface = (StubgenInterface){
+                        .name = strdup(words[1]),
+                        .prefix = strdup(words[2]),
+                };
+                if (!interface->name || !interface->prefix)
+                        return -ENOMEM;
+        } else if (!strcmp(words[0], "member")) {
+                if (n_words != 4)
+                        return stubgen_error(stubgen, "expected: member <name> <input> <output>");
+                if (!stubgen->n_interfaces)
+                        return stubgen_error(stubgen, "member outside of interface");
+                if (!stubgen_signature_is_valid(words[2]))
+                        return stubgen_error(stubgen, "invalid or unsupported signature '%s'", words[2]);
+                if (!stubgen_signature_is_valid(words[3]))
+                        return stubgen_error(stubgen, "invalid or unsupported signature '%s'", words[3]);
+
+                interface = &stubgen->interfaces[stubgen->n_interfaces - 1];
+
+                p = realloc(interface->members, (interface->n_members + 1) * sizeof(*interface->members));
+                if (!p)
+                        return -ENOMEM;
+                interface->members = p;
+
+                member = &interface->members[interface->n_members++];
+                *member = (StubgenMember){
+                        .name = strdup(words[1]),
+                        .cname = stubgen_cname(words[1]),
+                        .input = strdup(words[2]),
+                        .output = strdup(words[3]),
+                };
+                if (!member->name || !member->cname || !member->input || !member->output)
+                        return -ENOMEM;
+        } else {
+                return stubgen_error(stubgen, "unknown declaration '%s'", words[0]);
+        }
+
+        return 0;
+}
+
+static int stubgen_parse(Stubgen *stubgen, FILE *f) {
+        char *line = NULL;
+        size_t n_line = 0;
+        int r = 0;
+
+        while (getline(&line, &n_line, f) >= 0) {
+                ++stubgen->line;
+
+                r = stubgen_parse_line(stubgen, line);
+                if (r < 0)
+                        break;
+        }
+
+        free(line);
+        return r;
+}
+
+static void stubgen_free(Stubgen *stubgen) {
+        for (size_t i = 0; i < stubgen->n_interfaces; ++i) {
+                StubgenInterface *interface = &stubgen->interfaces[i];
+
+                for (size_t j = 0; j < interface->n_members; ++j) {
+                        free(interface->members[j].name);
+                        free(interface->members[j].cname);
+                        free(interface->members[j].input);
+                        free(interface->members[j].output);
+                }
+
+                free(interface->members);
+                free(interface->name);
+                free(interface->prefix);
+        }
+
+        free(stubgen->interfaces);
+}
+
+/*
+ * Print the arguments of @signature, one per basic type, in the order they
+ * are serialized. With @pointers set, pointers to the arguments are printed.
+ * If @names is set, the argument names are printed instead of declarations.
+ */
+static void stubgen_print_args(FILE *out, const char *signature, bool pointers, bool names) {
+        unsigned int n = 0;
+
+        for (const char *s = signature; *s; ++s) {
+                if (!stubgen_ctype(*s))
+                        continue;
+
+                if (names)
+                        fprintf(out, ", %sa%u", pointers ? "&" : "", n++);
+                else
+                        fprintf(out, ", %s%s%sa%u",
+                                stubgen_ctype(*s),
+                                stubgen_is_pointer(*s) ? "" : " ",
+                                pointers ? "*" : "",
+                                n++);
+        }
+}
+
+static void stubgen_print_locals(FILE *out, const char *signature) {
+        unsigned int n = 0;
+
+        for (const char *s = signature; *s; ++s) {
+                if (!stubgen_ctype(*s))
+                        continue;
+
+                if (stubgen_is_pointer(*s))
+                        fprintf(out, "        %sa%u = NULL;\n", stubgen_ctype(*s), n++);
+                else
+                        fprintf(out, "        %s a%u = 0;\n", stubgen_ctype(*s), n++);
+        }
+}
+
+/*
+ * Print the fields of a structure matching the serialization of the type at
+ * *@signaturep. Nested structures are numbered in the order they are opened,
+ * the top-level structure is the one being declared.
+ */
+static void stubgen_print_fields(FILE *out, const char **signaturep, unsigned int *np, unsigned int *mp, unsigned int depth) {
+        int indent = 8 * ((depth ?: 1) + 1);
+        char c = *(*signaturep)++;
+        unsigned int m;
+
+        if (c != '(') {
+                /* serialized booleans are a single byte */
+                fprintf(out, "%*s%s a%u%s;\n", indent, "",
+                        c == 'b' ? "uint8_t" : stubgen_ctype(c),
+                        (*np)++,
+                        stubgen_size(c) == 8 ? " __attribute__((__aligned__(8)))" : "");
+                return;
+        }
+
+        m = (*mp)++;
+        if (depth > 0)
+                fprintf(out, "%*sstruct {\n", indent, "");
+
+        while (**signaturep != ')')
+                stubgen_print_fields(out, signaturep, np, mp, depth + 1);
+        ++*signaturep;
+
+        if (depth > 0)
+                fprintf(out, "%*s} s%u;\n", indent, "", m);
+}
+
+/* print assignments of all arguments to the fields printed above */
+static void stubgen_print_assignments(FILE *out, const char **signaturep, char *path, size_t n_path,
+                                      unsigned int *np, unsigned int *mp, unsigned int depth) {
+        size_t len = strlen(path);
+        char c = *(*signaturep)++;
+        unsigned int m;
+
+        if (c != '(') {
+                fprintf(out, "        data%s.a%u = %sa%u;\n", path, *np, c == 'b' ? "!!" : "", *np);
+                ++*np;
+                return;
+        }
+
+        m = (*mp)++;
+        if (depth > 0)
+                snprintf(path + len, n_path - len, ".s%u", m);
+
+        while (**signaturep != ')')
+                stubgen_print_assignments(out, signaturep, path, n_path, np, mp, depth + 1);
+        ++*signaturep;
+
+        path[len] = 0;
+}
+
+static void stubgen_print_write(FILE *out, const char *signature) {
+        unsigned int n = 0, m = 0;
+        const char *s;
+        char path[256] = "";
+        size_t size;
+
+        if (!strcmp(signature, "()")) {
+                fprintf(out, "        (void)message;\n");
+                fprintf(out, "        return 0;\n");
+                return;
+        }
+
+        if (!stubgen_is_fixed(signature, &size)) {
+                fprintf(out, "        return b1_message_write(message, \"%s\"", signature);
+                stubgen_print_args(out, signature, false, true);
+                fprintf(out, ");\n");
+                return;
+        }
+
+        fprintf(out, "        struct {\n");
+        s = signature;
+        stubgen_print_fields(out, &s, &n, &m, 0);
+        fprintf(out, "        } data = {};\n");
+        fprintf(out, "        struct iovec vec = { &data, sizeof(data) };\n");
+        fprintf(out, "        _Static_assert(sizeof(data) == %zu, \"invalid layout of %s\");\n\n",
+                size, signature);
+
+        n = m = 0;
+        s = signature;
+        stubgen_print_assignments(out, &s, path, sizeof(path), &n, &m, 0);
+
+        fprintf(out, "\n        return b1_message_insert(message, \"%s\", &vec, 1);\n", signature);
+}
+
+static void stubgen_print_read(FILE *out, const char *signature) {
+        if (!strcmp(signature, "()")) {
+                fprintf(out, "        (void)message;\n");
+                fprintf(out, "        return 0;\n");
+                return;
+        }
+
+        fprintf(out, "        return b1_message_read(message, \"%s\"", signature);
+        stubgen_print_args(out, signature, false, true);
+        fprintf(out, ");\n");
+}
+
+static void stubgen_print_prototypes(FILE *out, StubgenInterface *interface, StubgenMember *member, const char *end) {
+        const char *p = interface->prefix, *m = member->cname;
+
+        fprintf(out, "int %s_%s_call(B1Peer *peer, B1Handle *handle", p, m);
+        stubgen_print_args(out, member->input, false, false);
+        fprintf(out, ", B1ReplySlot **slotp, B1ReplySlotFn fn, void *userdata)%s", end);
+
+        fprintf(out, "int %s_%s_write(B1Message *message", p, m);
+        stubgen_print_args(out, member->input, false, false);
+        fprintf(out, ")%s", end);
+
+        fprintf(out, "int %s_%s_read(B1Message *message", p, m);
+        stubgen_print_args(out, member->input, true, false);
+        fprintf(out, ")%s", end);
+
+        fprintf(out, "int %s_%s_reply(B1Message *origin", p, m);
+        stubgen_print_args(out, member->output, false, false);
+        fprintf(out, ")%s", end);
+
+        fprintf(out, "int %s_%s_write_reply(B1Message *message", p, m);
+        stubgen_print_args(out, member->output, false, false);
+        fprintf(out, ")%s", end);
+
+        fprintf(out, "int %s_%s_read_reply(B1Message *message", p, m);
+        stubgen_print_args(out, member->output, true, false);
+        fprintf(out, ")%s", end);
+}
+
+static void stubgen_print_header(Stubgen *stubgen, FILE *out) {
+        fprintf(out, "#pragma once\n\n");
+        fprintf(out, "/* generated by b1-stubgen from %s, do not edit */\n\n", stubgen->path);
+        fprintf(out, "#include <org.bus1/b1-peer.h>\n\n");
+        fprintf(out, "#ifdef __cplusplus\nextern \"C\" {\n#endif\n");
+
+        for (size_t i = 0; i < stubgen->n_interfaces; ++i) {
+                StubgenInterface *interface = &stubgen->interfaces[i];
+
+                fprintf(out, "\n/* %s */\n\n", interface->name);
+                fprintf(out, "int %s_interface_new(B1Interface **interfacep);\n", interface->prefix);
+
+                for (size_t j = 0; j < interface->n_members; ++j) {
+                        StubgenMember *member = &interface->members[j];
+
+                        fprintf(out, "\n");
+                        stubgen_print_prototypes(out, interface, member, ";\n");
+
+                        fprintf(out, "/* to be provided by the implementation */\n");
+                        fprintf(out, "int %s_%s(B1Node *node, void *userdata, B1Message *message",
+                                interface->prefix, member->cname);
+                        stubgen_print_args(out, member->input, false, false);
+                        fprintf(out, ");\n");
+                }
+        }
+
+        fprintf(out, "\n#ifdef __cplusplus\n}\n#endif\n");
+}
+
+static void stubgen_print_member(FILE *out, StubgenInterface *interface, StubgenMember *member) {
+        const char *p = interface->prefix, *m = member->cname;
+
+        fprintf(out, "\nint %s_%s_write(B1Message *message", p, m);
+        stubgen_print_args(out, member->input, false, false);
+        fprintf(out, ") {\n");
+        stubgen_print_write(out, member->input);
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nint %s_%s_read(B1Message *message", p, m);
+        stubgen_print_args(out, member->input, true, false);
+        fprintf(out, ") {\n");
+        stubgen_print_read(out, member->input);
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nint %s_%s_write_reply(B1Message *message", p, m);
+        stubgen_print_args(out, member->output, false, false);
+        fprintf(out, ") {\n");
+        stubgen_print_write(out, member->output);
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nint %s_%s_read_reply(B1Message *message", p, m);
+        stubgen_print_args(out, member->output, true, false);
+        fprintf(out, ") {\n");
+        stubgen_print_read(out, member->output);
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nint %s_%s_call(B1Peer *peer, B1Handle *handle", p, m);
+        stubgen_print_args(out, member->input, false, false);
+        fprintf(out, ", B1ReplySlot **slotp, B1ReplySlotFn fn, void *userdata) {\n");
+        fprintf(out, "        B1Message *message = NULL;\n");
+        fprintf(out, "        int r;\n\n");
+        fprintf(out, "        r = b1_message_new_call(peer, &message, \"%s\", \"%s\", \"%s\", \"%s\", slotp, fn, userdata);\n",
+                interface->name, member->name, stubgen_message_signature(member->input), member->output);
+        fprintf(out, "        if (r < 0)\n");
+        fprintf(out, "                return r;\n\n");
+        fprintf(out, "        r = %s_%s_write(message", p, m);
+        stubgen_print_args(out, member->input, false, true);
+        fprintf(out, ");\n");
+        fprintf(out, "        if (r >= 0)\n");
+        fprintf(out, "                r = b1_message_send(message, &handle, 1);\n\n");
+        fprintf(out, "        b1_message_unref(message);\n");
+        fprintf(out, "        return r;\n");
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nint %s_%s_reply(B1Message *origin", p, m);
+        stubgen_print_args(out, member->output, false, false);
+        fprintf(out, ") {\n");
+        fprintf(out, "        B1Message *message = NULL;\n");
+        fprintf(out, "        B1Handle *handle;\n");
+        fprintf(out, "        int r;\n\n");
+        fprintf(out, "        handle = b1_message_get_reply_handle(origin);\n");
+        fprintf(out, "        if (!handle)\n");
+        fprintf(out, "                return -EINVAL;\n\n");
+        fprintf(out, "        r = b1_message_new_reply(b1_handle_get_peer(handle), &message, \"%s\", \"\", NULL, NULL, NULL);\n",
+                stubgen_message_signature(member->output));
+        fprintf(out, "        if (r < 0)\n");
+        fprintf(out, "                return r;\n\n");
+        fprintf(out, "        r = %s_%s_write_reply(message", p, m);
+        stubgen_print_args(out, member->output, false, true);
+        fprintf(out, ");\n");
+        fprintf(out, "        if (r >= 0)\n");
+        fprintf(out, "                r = b1_message_send(message, &handle, 1);\n\n");
+        fprintf(out, "        b1_message_unref(message);\n");
+        fprintf(out, "        return r;\n");
+        fprintf(out, "}\n");
+
+        fprintf(out, "\nstatic int %s_%s_trampoline(B1Node *node, void *userdata, B1Message *message) {\n", p, m);
+        stubgen_print_locals(out, member->input);
+        fprintf(out, "        int r;\n\n");
+        fprintf(out, "        r = %s_%s_read(message", p, m);
+        stubgen_print_args(out, member->input, true, true);
+        fprintf(out, ");\n");
+        fprintf(out, "        if (r < 0)\n");
+        fprintf(out, "                return r;\n\n");
+        fprintf(out, "        return %s_%s(node, userdata, message", p, m);
+        stubgen_print_args(out, member->input, false, true);
+        fprintf(out, ");\n");
+        fprintf(out, "}\n");
+}
+
+static void stubgen_print_source(Stubgen *stubgen, FILE *out, const char *header) {
+        fprintf(out, "/* generated by b1-stubgen from %s, do not edit */\n\n", stubgen->path);
+        fprintf(out, "#include <errno.h>\n");
+        fprintf(out, "#include <stdbool.h>\n");
+        fprintf(out, "#include <stdint.h>\n");
+        fprintf(out, "#include <sys/uio.h>\n");
+        fprintf(out, "#include \"%s\"\n", header);
+
+        for (size_t i = 0; i < stubgen->n_interfaces; ++i) {
+                StubgenInterface *interface = &stubgen->interfaces[i];
+
+                for (size_t j = 0; j < interface->n_members; ++j)
+                        stubgen_print_member(out, interface, &interface->members[j]);
+
+                fprintf(out, "\nint %s_interface_new(B1Interface **interfacep) {\n", interface->prefix);
+                fprintf(out, "        B1Interface *interface = NULL;\n");
+                fprintf(out, "        int r;\n\n");
+                fprintf(out, "        r = b1_interface_new(&interface, \"%s\");\n", interface->name);
+                fprintf(out, "        if (r < 0)\n");
+                fprintf(out, "                return r;\n");
+
+                for (size_t j = 0; j < interface->n_members; ++j) {
+                        StubgenMember *member = &interface->members[j];
+
+                        fprintf(out, "\n        r = b1_interface_add_member(interface, \"%s\", \"%s\", \"%s\", %s_%s_trampoline);\n",
+                                member->name, member->input, member->output, interface->prefix, member->cname);
+                        fprintf(out, "        if (r < 0) {\n");
+                        fprintf(out, "                b1_interface_unref(interface);\n");
+                        fprintf(out, "                return r;\n");
+                        fprintf(out, "        }\n");
+                }
+
+                fprintf(out, "\n        *interfacep = interface;\n");
+                fprintf(out, "        return 0;\n");
+                fprintf(out, "}\n");
+        }
+}
+
+int main(int argc, char **argv) {
+        Stubgen stubgen = {};
+        FILE *f;
+        int r;
+
+        if ((argc != 3 || strcmp(argv[1], "--header")) &&
+            (argc != 4 || strcmp(argv[1], "--source"))) {
+                fprintf(stderr, "Usage: %s --header INPUT\n", program_invocation_short_name);
+                fprintf(stderr, "       %s --source INPUT HEADER\n", program_invocation_short_name);
+                return EXIT_FAILURE;
+        }
+
+        stubgen.path = argv[2];
+
+        f = fopen(stubgen.path, "re");
+        if (!f) {
+                fprintf(stderr, "%s: %m\n", stubgen.path);
+                return EXIT_FAILURE;
+        }
+
+        r = stubgen_parse(&stubgen, f);
+        fclose(f);
+        if (r < 0) {
+                if (r == -ENOMEM)
+                        fprintf(stderr, "%s: out of memory\n", stubgen.path);
+                stubgen_free(&stubgen);
+                return EXIT_FAILURE;
+        }
+
+        if (argc == 3)
+                stubgen_print_header(&stubgen, stdout);
+        else
+                stubgen_print_source(&stubgen, stdout, argv[3]);
+
+        stubgen_free(&stubgen);
+
+        return fflush(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
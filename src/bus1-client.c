@@ -17,6 +17,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include "bus1-client.h"
 
@@ -24,6 +25,8 @@ struct bus1_client {
 	int fd;
 	void *pool;
 	size_t pool_size;
+	struct bus1_client_stats *stats;
+	struct bus1_client_stats *stats_active;
 };
 
 #define _cleanup_(_x) __attribute__((__cleanup__(_x)))
@@ -44,6 +47,8 @@ _public_ int bus1_client_new_from_fd(struct bus1_client **clientp, int fd)
 	client->fd = fd;
 	client->pool = NULL;
 	client->pool_size = 0;
+	client->stats = NULL;
+	client->stats_active = NULL;
 
 	*clientp = client;
 	client = NULL;
@@ -78,6 +83,7 @@ _public_ struct bus1_client *bus1_client_free(struct bus1_client *client)
 		munmap(client->pool, client->pool_size);
 
 	close(client->fd);
+	free(client->stats);
 	free(client);
 
 	return NULL;
@@ -98,14 +104,119 @@ _public_ void *bus1_client_get_pool(struct bus1_client *client)
 	return client ? client->pool : NULL;
 }
 
+_public_ int bus1_client_set_stats(struct bus1_client *client, bool enable)
+{
+	struct bus1_client_stats *stats;
+
+	/*
+	 * The statistics object is allocated on first use and never freed
+	 * before the client is, so racing ioctls can keep accounting to it
+	 * while statistics are disabled. Only constructors and destructors
+	 * are excluded from parallel access, and this is neither, so the
+	 * allocation must be published atomically.
+	 */
+
+	if (!enable) {
+		__atomic_store_n(&client->stats_active, NULL, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	stats = __atomic_load_n(&client->stats, __ATOMIC_ACQUIRE);
+	if (!stats) {
+		struct bus1_client_stats *old = NULL;
+
+		stats = calloc(1, sizeof(*stats));
+		if (!stats)
+			return -ENOMEM;
+
+		if (!__atomic_compare_exchange_n(&client->stats, &old, stats,
+						 false, __ATOMIC_RELEASE,
+						 __ATOMIC_ACQUIRE)) {
+			free(stats);
+			stats = old;
+		}
+	}
+
+	__atomic_store_n(&client->stats_active, stats, __ATOMIC_RELEASE);
+	return 0;
+}
+
+_public_ void bus1_client_get_stats(struct bus1_client *client,
+				    struct bus1_client_stats *stats)
+{
+	const uint64_t *src;
+	uint64_t *dst;
+	size_t i;
+
+	src = (const uint64_t *)__atomic_load_n(&client->stats,
+						__ATOMIC_ACQUIRE);
+	if (!src) {
+		*stats = (struct bus1_client_stats){};
+		return;
+	}
+
+	dst = (uint64_t *)stats;
+	for (i = 0; i < sizeof(*stats) / sizeof(uint64_t); ++i)
+		dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+static uint64_t bus1_client_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bus1_client_account(struct bus1_client_stats *stats,
+				unsigned int cmd,
+				int r,
+				uint64_t nsec)
+{
+	unsigned int nr = _IOC_NR(cmd), bucket;
+
+	if (_unlikely_(nr >= BUS1_CLIENT_STATS_CMD_MAX))
+		return;
+
+	bucket = 63 - __builtin_clzll(nsec | 1);
+	if (bucket >= BUS1_CLIENT_STATS_BUCKETS)
+		bucket = BUS1_CLIENT_STATS_BUCKETS - 1;
+
+	__atomic_fetch_add(&stats->cmds[nr].n_calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->cmds[nr].total_nsec, nsec, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&stats->cmds[nr].latency[bucket], 1,
+			   __ATOMIC_RELAXED);
+
+	if (r < 0) {
+		__atomic_fetch_add(&stats->cmds[nr].n_errors, 1,
+				   __ATOMIC_RELAXED);
+		if (-r < BUS1_CLIENT_STATS_ERRNO_MAX)
+			__atomic_fetch_add(&stats->errnos[-r], 1,
+					   __ATOMIC_RELAXED);
+	}
+}
+
 _public_ int bus1_client_ioctl(struct bus1_client *client,
 			       unsigned int cmd,
 			       void *arg)
 {
+	struct bus1_client_stats *stats;
+	uint64_t start;
 	int r;
 
+	stats = __atomic_load_n(&client->stats_active, __ATOMIC_RELAXED);
+	if (_likely_(!stats)) {
+		r = ioctl(client->fd, cmd, arg);
+		return r >= 0 ? r : -errno;
+	}
+
+	start = bus1_client_now();
 	r = ioctl(client->fd, cmd, arg);
-	return r >= 0 ? r : -errno;
+	if (r < 0)
+		r = -errno;
+	bus1_client_account(stats, cmd, r, bus1_client_now() - start);
+
+	return r;
 }
 
 _public_ int bus1_client_query(struct bus1_client *client, size_t *pool_sizep)
@@ -134,11 +245,11 @@ _public_ int bus1_client_query(struct bus1_client *client, size_t *pool_sizep)
 	return 0;
 }
 
-_public_ int bus1_client_mmap(struct bus1_client *client)
+_public_ int bus1_client_mmap(struct bus1_client *client, unsigned int flags)
 {
 	const void *pool, *old_pool;
 	size_t pool_size, old_size;
-	int r;
+	int r, map_flags = MAP_SHARED;
 
 	r = bus1_client_query(client, &pool_size);
 	if (r < 0)
@@ -171,13 +282,31 @@ _public_ int bus1_client_mmap(struct bus1_client *client)
 		return 0;
 	}
 
-	pool = mmap(NULL, pool_size, PROT_READ, MAP_SHARED, client->fd, 0);
+	/*
+	 * Optionally fault in the whole pool upfront, so the first messages
+	 * do not pay for page faults, pin it in memory, and ask for
+	 * transparent hugepages. The latter is merely advice and may not be
+	 * supported on the pool, so failures are ignored.
+	 */
+	if (flags & BUS1_CLIENT_MMAP_POPULATE)
+		map_flags |= MAP_POPULATE;
+
+	pool = mmap(NULL, pool_size, PROT_READ, map_flags, client->fd, 0);
 	if (pool == MAP_FAILED)
 		return -errno;
 
 	/* NULL is never mapped if we let the kernel choose; we rely on this */
 	assert(pool != NULL);
 
+	if (flags & BUS1_CLIENT_MMAP_HUGEPAGE)
+		(void)madvise((void *)pool, pool_size, MADV_HUGEPAGE);
+
+	if ((flags & BUS1_CLIENT_MMAP_LOCK) && mlock(pool, pool_size) < 0) {
+		r = -errno;
+		munmap((void *)pool, pool_size);
+		return r;
+	}
+
 	/* no reason to be atomic, but lets verify the semantics nonetheless */
 	old_size = __atomic_exchange_n(&client->pool_size, pool_size,
 				       __ATOMIC_RELEASE);
@@ -27,6 +27,7 @@
 
 #include <inttypes.h>
 #include <linux/bus1.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <sys/uio.h>
 
@@ -38,6 +39,32 @@ struct bus1_client;
 
 #define BUS1_CLIENT_POOL_SIZE (32ULL * 1024ULL * 1024ULL)
 
+enum {
+	BUS1_CLIENT_MMAP_POPULATE	= 1U << 0,
+	BUS1_CLIENT_MMAP_LOCK		= 1U << 1,
+	BUS1_CLIENT_MMAP_HUGEPAGE	= 1U << 2,
+};
+
+#define BUS1_CLIENT_STATS_CMD_MAX	(16)
+#define BUS1_CLIENT_STATS_BUCKETS	(32)
+#define BUS1_CLIENT_STATS_ERRNO_MAX	(160)
+
+/*
+ * Per-command ioctl statistics, indexed by _IOC_NR() of the command. Latencies
+ * are counted in log2 buckets of nanoseconds, bucket N covering [2^N, 2^(N+1))
+ * with the last bucket covering everything above. Errors are additionally
+ * counted per errno, across all commands.
+ */
+struct bus1_client_stats {
+	struct {
+		uint64_t n_calls;
+		uint64_t n_errors;
+		uint64_t total_nsec;
+		uint64_t latency[BUS1_CLIENT_STATS_BUCKETS];
+	} cmds[BUS1_CLIENT_STATS_CMD_MAX];
+	uint64_t errnos[BUS1_CLIENT_STATS_ERRNO_MAX];
+};
+
 int bus1_client_new_from_fd(struct bus1_client **clientp, int fd);
 int bus1_client_new_from_path(struct bus1_client **clientp, const char *path);
 struct bus1_client *bus1_client_free(struct bus1_client *client);
@@ -46,9 +73,13 @@ int bus1_client_get_fd(struct bus1_client *client);
 size_t bus1_client_get_pool_size(struct bus1_client *client);
 void *bus1_client_get_pool(struct bus1_client *client);
 
+int bus1_client_set_stats(struct bus1_client *client, bool enable);
+void bus1_client_get_stats(struct bus1_client *client,
+			   struct bus1_client_stats *stats);
+
 int bus1_client_ioctl(struct bus1_client *client, unsigned int cmd, void *arg);
 int bus1_client_query(struct bus1_client *client, size_t *pool_sizep);
-int bus1_client_mmap(struct bus1_client *client);
+int bus1_client_mmap(struct bus1_client *client, unsigned int flags);
 int bus1_client_init(struct bus1_client *client, size_t pool_size);
 int bus1_client_clone(struct bus1_client *client,
 		      uint64_t *nodep,
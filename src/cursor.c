@@ -0,0 +1,419 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Cursors
+ *
+ * A cursor walks the values of a container in the payload of a received
+ * message, in place in the pool. Rather than interpreting a type string for
+ * every value, it follows the type tree of a compiled signature, and locates
+ * values by the GVariant framing alone: elements of fixed size are found by
+ * their index, all others by the framing offsets of their container. Hence,
+ * stepping over a value is O(1), no matter how large the subtree below it.
+ *
+ * Cursors do not allocate and hold no references. They are valid as long as
+ * the message and the signature they were opened with.
+ */
+
+#include <assert.h>
+#include <c-macro.h>
+#include <endian.h>
+#include <errno.h>
+#include "message.h"
+#include "signature.h"
+#include <stdlib.h>
+#include <string.h>
+#include "org.bus1/b1-peer.h"
+
+static size_t b1_cursor_offset_size(size_t n_data) {
+        if (n_data > UINT32_MAX)
+                return 8;
+        else if (n_data > UINT16_MAX)
+                return 4;
+        else if (n_data > UINT8_MAX)
+                return 2;
+        else if (n_data > 0)
+                return 1;
+        else
+                return 0;
+}
+
+static size_t b1_cursor_read_offset(const uint8_t *p, size_t offset_size) {
+        uint64_t v = 0;
+
+        /* framing offsets are unaligned little-endian integers */
+        memcpy(&v, p, offset_size);
+
+        return le64toh(v);
+}
+
+/*
+ * Locate the current value of @cursor, and advance to the next one. Return
+ * false, leaving the cursor untouched, if there is none or it is malformed.
+ */
+static bool b1_cursor_step(B1Cursor *cursor, size_t *startp, size_t *endp) {
+        B1SignatureType *type;
+        size_t start, end;
+        bool framed = false;
+
+        if (cursor->index >= cursor->n_values)
+                return false;
+
+        type = &cursor->signature->types[cursor->type];
+
+        switch (cursor->container) {
+        case 'a':
+                if (type->size) {
+                        start = cursor->index * type->size;
+                        end = start + type->size;
+                        break;
+                }
+
+                start = 0;
+                if (cursor->index > 0)
+                        start = c_align_to(b1_cursor_read_offset(cursor->data + cursor->offsets +
+                                                                 (cursor->index - 1) * cursor->offset_size,
+                                                                 cursor->offset_size),
+                                           type->alignment);
+                end = b1_cursor_read_offset(cursor->data + cursor->offsets +
+                                            cursor->index * cursor->offset_size,
+                                            cursor->offset_size);
+                break;
+        case 'm':
+                start = 0;
+                end = type->size ?: cursor->offsets - 1;
+                break;
+        case '(':
+        case '{':
+                start = c_align_to(cursor->position, type->alignment);
+
+                if (type->size) {
+                        end = start + type->size;
+                } else if (cursor->index + 1 == cursor->n_values) {
+                        end = cursor->offsets;
+                } else {
+                        /* framing offsets are stored in reverse order */
+                        end = b1_cursor_read_offset(cursor->data + cursor->n_data -
+                                                    (cursor->frame + 1) * cursor->offset_size,
+                                                    cursor->offset_size);
+                        framed = true;
+                }
+                break;
+        default:
+                start = 0;
+                end = cursor->offsets;
+                break;
+        }
+
+        if (start > end || end > cursor->offsets)
+                return false;
+
+        ++cursor->index;
+
+        if (cursor->container == '(' || cursor->container == '{') {
+                cursor->position = end;
+                cursor->frame += framed;
+                cursor->type += type->n_type;
+        }
+
+        *startp = start;
+        *endp = end;
+        return true;
+}
+
+/*
+ * Set up @cursor to walk the members of @data, which is a single value of the
+ * container type at @type in @signature.
+ */
+static int b1_cursor_init(B1Cursor *cursor,
+                          B1Signature *signature,
+                          size_t type,
+                          const uint8_t *data,
+                          size_t n_data) {
+        B1SignatureType *container = &signature->types[type], *element;
+        size_t end, n_frames = 0;
+
+        *cursor = (B1Cursor){
+                .signature = signature,
+                .data = data,
+                .n_data = n_data,
+                .offsets = n_data,
+                .type = type + 1,
+                .container = container->element,
+        };
+
+        element = &signature->types[cursor->type];
+
+        switch (container->element) {
+        case 'a':
+                if (element->size) {
+                        if (n_data % element->size)
+                                return -EBADMSG;
+
+                        cursor->n_values = n_data / element->size;
+                } else if (n_data > 0) {
+                        cursor->offset_size = b1_cursor_offset_size(n_data);
+                        end = b1_cursor_read_offset(data + n_data - cursor->offset_size,
+                                                    cursor->offset_size);
+                        if (end > n_data || (n_data - end) % cursor->offset_size)
+                                return -EBADMSG;
+
+                        cursor->offsets = end;
+                        cursor->n_values = (n_data - end) / cursor->offset_size;
+                }
+                break;
+        case 'm':
+                if (n_data == 0)
+                        break;
+                if (element->size && n_data != element->size)
+                        return -EBADMSG;
+
+                cursor->n_values = 1;
+                break;
+        case '(':
+        case '{':
+                if (container->size) {
+                        if (n_data != container->size)
+                                return -EBADMSG;
+
+                        for (size_t i = type + 1; i < type + container->n_type - 1;
+                             i += signature->types[i].n_type)
+                                ++cursor->n_values;
+                        break;
+                }
+
+                /* all members of variable size but the last one are framed */
+                for (size_t i = type + 1; i < type + container->n_type - 1;
+                     i += signature->types[i].n_type) {
+                        n_frames += !signature->types[i].size;
+                        ++cursor->n_values;
+                        element = &signature->types[i];
+                }
+                n_frames -= !element->size;
+
+                cursor->offset_size = b1_cursor_offset_size(n_data);
+                if (n_frames * cursor->offset_size > n_data)
+                        return -EBADMSG;
+
+                cursor->offsets = n_data - n_frames * cursor->offset_size;
+                break;
+        default:
+                return -EINVAL;
+        }
+
+        return 0;
+}
+
+/**
+ * b1_message_open_cursor() - open a cursor on the payload of a message
+ * @message:            the received message
+ * @signature:          the signature of the payload
+ * @cursor:             the cursor to initialize
+ *
+ * A cursor walks containers in the payload of @message in place, without
+ * copying or interpreting a type string per value. The payload must be of
+ * type @signature, which the cursor follows. Initially, the cursor holds the
+ * payload as its only value, use b1_cursor_enter() to descend into it. Hence,
+ * @signature must be a single complete type, such as "(us)" rather than "us".
+ *
+ * The cursor does not allocate, and needs no cleanup. It must not be used
+ * after @message or @signature have been released.
+ *
+ * Return: 0 on success, -EINVAL if @message was not received, @signature is
+ *         not a single complete type or @message is not of type @signature,
+ *         or -EBADMSG if it is malformed.
+ */
+_c_public_ int b1_message_open_cursor(B1Message *message, B1Signature *signature, B1Cursor *cursor) {
+        const uint8_t *envelope, *type;
+        size_t n_envelope, offset_size, start, end;
+
+        assert(signature);
+        assert(cursor);
+
+        if (!message || message->type == B1_MESSAGE_TYPE_NODE_DESTROY || !message->data.slice)
+                return -EINVAL;
+
+        /* the root cursor holds one value, of the first type of @signature */
+        if (signature->n_types > 1)
+                return -EINVAL;
+
+        /* the payload is the last variant of the "(tvv)" envelope */
+        envelope = message->data.slice;
+        n_envelope = message->data.n_envelope;
+        offset_size = b1_cursor_offset_size(n_envelope);
+        if (n_envelope < sizeof(uint64_t) + offset_size)
+                return -EBADMSG;
+
+        start = b1_cursor_read_offset(envelope + n_envelope - offset_size, offset_size);
+        start = c_align_to(start, 8);
+        end = n_envelope - offset_size;
+        if (start < sizeof(uint64_t) || start > end)
+                return -EBADMSG;
+
+        /* a variant is its value, followed by a NUL byte and its type */
+        type = memrchr(envelope + start, 0, end - start);
+        if (!type)
+                return -EBADMSG;
+
+        ++type;
+        if ((size_t)(envelope + end - type) == signature->n_string &&
+            !memcmp(type, signature->string, signature->n_string)) {
+                *cursor = (B1Cursor){
+                        .signature = signature,
+                        .data = envelope + start,
+                        .n_data = type - 1 - (envelope + start),
+                        .offsets = type - 1 - (envelope + start),
+                        .n_values = signature->n_string > 0,
+                };
+        } else if (signature->n_string == 0 && envelope + end - type == 2 && !memcmp(type, "()", 2)) {
+                *cursor = (B1Cursor){
+                        .signature = signature,
+                };
+        } else {
+                return -EINVAL;
+        }
+
+        return 0;
+}
+
+/**
+ * b1_cursor_enter() - descend into the current value
+ * @cursor:             the cursor
+ * @child:              the cursor to initialize
+ *
+ * The current value of @cursor must be an array, a maybe, a structure or a
+ * dict entry. @child is set up to walk its elements or members, and @cursor
+ * advances to the next value. The two cursors are independent, @child does
+ * not have to be walked to its end.
+ *
+ * Return: 0 on success, -EINVAL if the current value is not one of the above
+ *         containers, -ENOENT if there is no current value, or -EBADMSG if it
+ *         is malformed.
+ */
+_c_public_ int b1_cursor_enter(B1Cursor *cursor, B1Cursor *child) {
+        B1Cursor previous = *cursor;
+        size_t start, end;
+        int r;
+
+        if (cursor->index >= cursor->n_values)
+                return -ENOENT;
+
+        if (!strchr("am({", cursor->signature->string[cursor->type]))
+                return -EINVAL;
+
+        if (!b1_cursor_step(cursor, &start, &end))
+                return -EBADMSG;
+
+        r = b1_cursor_init(child, cursor->signature, previous.type,
+                           cursor->data + start, end - start);
+        if (r < 0) {
+                *cursor = previous;
+                return r;
+        }
+
+        return 0;
+}
+
+/**
+ * b1_cursor_next() - get the current value and advance
+ * @cursor:             the cursor
+ * @n_bytesp:           pointer to the returned size of the value, or NULL
+ *
+ * The returned value is serialized in the GVariant format, in place in the
+ * pool. Values of fixed size are laid out like the equivalent C type, and
+ * suitably aligned, so they can be accessed directly.
+ *
+ * Stepping over a value never looks at the values nested in it, so skipping
+ * a container is as cheap as skipping an integer.
+ *
+ * Return: the current value, or NULL if there is none or it is malformed. In
+ *         the latter case, b1_cursor_get_count() is non-zero.
+ */
+_c_public_ const void *b1_cursor_next(B1Cursor *cursor, size_t *n_bytesp) {
+        size_t start, end;
+
+        if (!b1_cursor_step(cursor, &start, &end)) {
+                if (n_bytesp)
+                        *n_bytesp = 0;
+                return NULL;
+        }
+
+        if (n_bytesp)
+                *n_bytesp = end - start;
+
+        return cursor->data + start;
+}
+
+/**
+ * b1_cursor_skip() - skip values
+ * @cursor:             the cursor
+ * @n_values:           number of values to skip
+ *
+ * In arrays, this takes constant time regardless of @n_values.
+ *
+ * Return: 0 on success, -ERANGE if fewer than @n_values are left, or -EBADMSG
+ *         if a value is malformed.
+ */
+_c_public_ int b1_cursor_skip(B1Cursor *cursor, size_t n_values) {
+        size_t start, end;
+
+        if (n_values > cursor->n_values - cursor->index)
+                return -ERANGE;
+
+        if (cursor->container == 'a') {
+                cursor->index += n_values;
+                return 0;
+        }
+
+        while (n_values--)
+                if (!b1_cursor_step(cursor, &start, &end))
+                        return -EBADMSG;
+
+        return 0;
+}
+
+/**
+ * b1_cursor_get_count() - get the number of values left
+ * @cursor:             the cursor
+ *
+ * Return: the number of values left in @cursor.
+ */
+_c_public_ size_t b1_cursor_get_count(B1Cursor *cursor) {
+        return cursor->n_values - cursor->index;
+}
+
+/**
+ * b1_cursor_peek_type() - get the type of the current value
+ * @cursor:             the cursor
+ * @n_typep:            pointer to the returned length of the type, or NULL
+ *
+ * The returned type is not NUL terminated.
+ *
+ * Return: the type of the current value, or NULL if there is none.
+ */
+_c_public_ const char *b1_cursor_peek_type(B1Cursor *cursor, size_t *n_typep) {
+        if (cursor->index >= cursor->n_values) {
+                if (n_typep)
+                        *n_typep = 0;
+                return NULL;
+        }
+
+        if (n_typep)
+                *n_typep = cursor->signature->types[cursor->type].n_type;
+
+        return cursor->signature->string + cursor->type;
+}
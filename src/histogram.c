@@ -0,0 +1,131 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Histograms
+ *
+ * Histograms are log-linear: every power of two is split into
+ * 2^B1_HISTOGRAM_SUB_BITS equally sized buckets, so the relative error of any
+ * recorded value is bounded by 2^-B1_HISTOGRAM_SUB_BITS, regardless of its
+ * magnitude. Values below 2^B1_HISTOGRAM_SUB_BITS are recorded exactly.
+ *
+ * Histograms may be shared between peers running on different threads, so all
+ * updates are atomic. Readers see each counter atomically, but not the
+ * histogram as a whole.
+ */
+
+#include <assert.h>
+#include <c-macro.h>
+#include "histogram.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define B1_HISTOGRAM_SUB (1U << B1_HISTOGRAM_SUB_BITS)
+
+static unsigned int b1_histogram_nsec_to_bucket(uint64_t nsec) {
+        unsigned int exponent;
+
+        if (nsec < B1_HISTOGRAM_SUB)
+                return nsec;
+
+        exponent = 63 - __builtin_clzll(nsec);
+
+        return ((exponent - B1_HISTOGRAM_SUB_BITS + 1) << B1_HISTOGRAM_SUB_BITS) |
+               ((nsec >> (exponent - B1_HISTOGRAM_SUB_BITS)) & (B1_HISTOGRAM_SUB - 1));
+}
+
+void b1_histogram_record(B1Histogram *histogram, uint64_t nsec) {
+        uint64_t max;
+
+        __atomic_fetch_add(&histogram->n_samples, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&histogram->sum_nsec, nsec, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&histogram->buckets[b1_histogram_nsec_to_bucket(nsec)], 1, __ATOMIC_RELAXED);
+
+        max = __atomic_load_n(&histogram->max_nsec, __ATOMIC_RELAXED);
+        while (nsec > max &&
+               !__atomic_compare_exchange_n(&histogram->max_nsec, &max, nsec, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+}
+
+void b1_histogram_accumulate(B1Histogram *histogram, const B1Histogram *source) {
+        histogram->n_samples += __atomic_load_n(&source->n_samples, __ATOMIC_RELAXED);
+        histogram->sum_nsec += __atomic_load_n(&source->sum_nsec, __ATOMIC_RELAXED);
+        histogram->max_nsec = c_max(histogram->max_nsec,
+                                    __atomic_load_n(&source->max_nsec, __ATOMIC_RELAXED));
+
+        for (unsigned int i = 0; i < B1_HISTOGRAM_BUCKETS; ++i)
+                histogram->buckets[i] += __atomic_load_n(&source->buckets[i], __ATOMIC_RELAXED);
+}
+
+void b1_histogram_reset(B1Histogram *histogram) {
+        __atomic_store_n(&histogram->n_samples, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->sum_nsec, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->max_nsec, 0, __ATOMIC_RELAXED);
+
+        for (unsigned int i = 0; i < B1_HISTOGRAM_BUCKETS; ++i)
+                __atomic_store_n(&histogram->buckets[i], 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * b1_histogram_bucket_to_nsec() - get lower bound of a histogram bucket
+ * @bucket:             index of the bucket
+ *
+ * Return: the smallest value, in nanoseconds, that is recorded in @bucket.
+ */
+_c_public_ uint64_t b1_histogram_bucket_to_nsec(unsigned int bucket) {
+        unsigned int group = bucket >> B1_HISTOGRAM_SUB_BITS;
+        uint64_t sub = bucket & (B1_HISTOGRAM_SUB - 1);
+
+        assert(bucket < B1_HISTOGRAM_BUCKETS);
+
+        if (!group)
+                return sub;
+
+        return (B1_HISTOGRAM_SUB | sub) << (group - 1);
+}
+
+/**
+ * b1_histogram_get_percentile() - estimate a percentile of a histogram
+ * @histogram:          histogram to query
+ * @percentile:         percentile to query, between 0 and 100
+ *
+ * This finds the bucket that contains the requested percentile and returns its
+ * upper bound, limited by the largest value recorded. The result therefore
+ * never underestimates the percentile.
+ *
+ * Return: the estimated percentile in nanoseconds, or 0 if the histogram is
+ *         empty.
+ */
+_c_public_ uint64_t b1_histogram_get_percentile(const B1Histogram *histogram, double percentile) {
+        uint64_t rank, n = 0;
+
+        assert(histogram);
+
+        if (!histogram->n_samples)
+                return 0;
+
+        rank = c_max((uint64_t)(histogram->n_samples * c_min(percentile, 100.0) / 100.0 + 0.5), (uint64_t)1);
+
+        for (unsigned int i = 0; i < B1_HISTOGRAM_BUCKETS - 1; ++i) {
+                n += histogram->buckets[i];
+                if (n >= rank)
+                        return c_min(b1_histogram_bucket_to_nsec(i + 1) - 1, histogram->max_nsec);
+        }
+
+        return histogram->max_nsec;
+}
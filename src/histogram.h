@@ -0,0 +1,23 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include "org.bus1/b1-peer.h"
+
+void b1_histogram_record(B1Histogram *histogram, uint64_t nsec);
+void b1_histogram_accumulate(B1Histogram *histogram, const B1Histogram *source);
+void b1_histogram_reset(B1Histogram *histogram);
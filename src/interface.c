@@ -19,7 +19,9 @@
 #include <c-macro.h>
 #include <c-rbtree.h>
 #include <errno.h>
+#include "histogram.h"
 #include "interface.h"
+#include "signature.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -43,6 +45,32 @@ B1Member *b1_interface_get_member(B1Interface *interface, const char *name) {
         return c_container_of(n, B1Member, rb);
 }
 
+/*
+ * Record a dispatch of @member. Statistics are allocated on first use and
+ * published atomically, as the interface may be shared between threads. If
+ * the allocation fails, the sample is dropped.
+ */
+void b1_member_record(B1Member *member, uint64_t handler_nsec, uint64_t queue_nsec, bool queued) {
+        B1MemberStats *stats, *old = NULL;
+
+        stats = __atomic_load_n(&member->stats, __ATOMIC_ACQUIRE);
+        if (_c_unlikely_(!stats)) {
+                stats = calloc(1, sizeof(*stats));
+                if (!stats)
+                        return;
+
+                if (!__atomic_compare_exchange_n(&member->stats, &old, stats, false,
+                                                 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                        free(stats);
+                        stats = old;
+                }
+        }
+
+        b1_histogram_record(&stats->handler, handler_nsec);
+        if (queued)
+                b1_histogram_record(&stats->queue, queue_nsec);
+}
+
 /**
  * b1_interface_new() - create new interface
  * @interfacep:         pointer to new interface object
@@ -122,6 +150,9 @@ _c_public_ B1Interface *b1_interface_unref(B1Interface *interface) {
                 B1Member *member = c_container_of(node, B1Member, rb);
 
                 c_rbtree_remove(&interface->members, node);
+                b1_signature_unref(member->signature_output);
+                b1_signature_unref(member->signature_input);
+                free(member->stats);
                 free(member);
         }
 
@@ -144,18 +175,22 @@ _c_public_ B1Interface *b1_interface_unref(B1Interface *interface) {
  * @type_input must describe the input types expected by the callback, which
  * will be pre-validated by the library on all input. @type_output describes
  * the types expected to be produced as a result, and is verified by the
- * library as well.
+ * library as well. Both are compiled and interned, so incoming messages are
+ * validated by comparing signature objects.
  *
- * Return: 0 on succes, or a negative error code on failure.
+ * Return: 0 on succes, -EINVAL if a type is not a valid signature, or a
+ *         negative error code on failure.
  */
 _c_public_ int b1_interface_add_member(B1Interface *interface,
                                        const char *name,
                                        const char *type_input,
                                        const char *type_output,
                                        B1NodeFn fn) {
-        size_t n_name, n_type_input, n_type_output;
+        _c_cleanup_(b1_signature_unrefp) B1Signature *signature = NULL, *signature_input = NULL, *signature_output = NULL;
+        size_t n_name;
         B1Member *member;
         CRBNode **slot, *p;
+        int r;
 
         assert(interface);
         assert(name);
@@ -170,23 +205,104 @@ _c_public_ int b1_interface_add_member(B1Interface *interface,
         if (!slot)
                 return -ENOTUNIQ;
 
+        r = b1_signature_new(&signature, type_input);
+        if (r < 0)
+                return r;
+
+        r = b1_signature_ref_payload(signature, &signature_input);
+        if (r < 0)
+                return r;
+
+        r = b1_signature_new(&signature_output, type_output);
+        if (r < 0)
+                return r;
+
         n_name = strlen(name) + 1;
-        n_type_input = strlen(type_input) + 1;
-        n_type_output = strlen(type_output) + 1;
-        member = malloc(sizeof(*member) + n_name + n_type_input + n_type_output);
+        member = malloc(sizeof(*member) + n_name);
         if (!member)
                 return -ENOMEM;
 
         c_rbnode_init(&member->rb);
         member->name = (void *)(member + 1);
-        member->type_input = member->name + n_name;
-        member->type_output = member->type_input + n_type_input;
+        member->signature_input = signature_input;
+        member->signature_output = signature_output;
         member->fn = fn;
+        member->stats = NULL;
+        signature_input = NULL;
+        signature_output = NULL;
 
         memcpy(member->name, name, n_name);
-        memcpy(member->type_input, type_input, n_type_input);
-        memcpy(member->type_output, type_output, n_type_output);
         c_rbtree_add(&interface->members, p, slot, &member->rb);
 
         return 0;
 }
+
+static void b1_member_accumulate(B1Member *member, B1MemberStats *statsp) {
+        B1MemberStats *stats;
+
+        stats = __atomic_load_n(&member->stats, __ATOMIC_ACQUIRE);
+        if (!stats)
+                return;
+
+        b1_histogram_accumulate(&statsp->handler, &stats->handler);
+        b1_histogram_accumulate(&statsp->queue, &stats->queue);
+}
+
+/**
+ * b1_interface_get_stats() - query dispatch statistics
+ * @interface:          interface to query
+ * @member:             name of the member to query, or NULL
+ * @statsp:             output argument for the statistics
+ *
+ * This returns a snapshot of the histograms recorded for @member while
+ * dispatching on peers with b1_peer_set_dispatch_stats() enabled. If @member
+ * is NULL, the histograms of all members of @interface are summed up.
+ *
+ * Return: 0 on success, or -ENOENT if @member does not exist.
+ */
+_c_public_ int b1_interface_get_stats(B1Interface *interface, const char *member, B1MemberStats *statsp) {
+        B1Member *m;
+        CRBNode *n;
+
+        assert(interface);
+        assert(statsp);
+
+        memset(statsp, 0, sizeof(*statsp));
+
+        if (member) {
+                m = b1_interface_get_member(interface, member);
+                if (!m)
+                        return -ENOENT;
+
+                b1_member_accumulate(m, statsp);
+                return 0;
+        }
+
+        for (n = c_rbtree_first(&interface->members); n; n = c_rbnode_next(n))
+                b1_member_accumulate(c_container_of(n, B1Member, rb), statsp);
+
+        return 0;
+}
+
+/**
+ * b1_interface_reset_stats() - reset dispatch statistics
+ * @interface:          interface to operate on
+ *
+ * This clears the histograms of all members of @interface. Samples recorded
+ * concurrently may be partially lost.
+ */
+_c_public_ void b1_interface_reset_stats(B1Interface *interface) {
+        B1MemberStats *stats;
+        CRBNode *n;
+
+        assert(interface);
+
+        for (n = c_rbtree_first(&interface->members); n; n = c_rbnode_next(n)) {
+                stats = __atomic_load_n(&c_container_of(n, B1Member, rb)->stats, __ATOMIC_ACQUIRE);
+                if (!stats)
+                        continue;
+
+                b1_histogram_reset(&stats->handler);
+                b1_histogram_reset(&stats->queue);
+        }
+}
@@ -31,9 +31,11 @@ struct B1Interface {
 typedef struct B1Member {
         CRBNode rb;
         char *name;
-        char *type_input;
-        char *type_output;
+        B1Signature *signature_input;
+        B1Signature *signature_output;
         B1NodeFn fn;
+        B1MemberStats *stats;
 } B1Member;
 
 B1Member *b1_interface_get_member(B1Interface *interface, const char *name);
+void b1_member_record(B1Member *member, uint64_t handler_nsec, uint64_t queue_nsec, bool queued);
@@ -24,18 +24,42 @@
 #include "message.h"
 #include "node.h"
 #include "peer.h"
+#include "recorder.h"
+#include "signature.h"
 #include <stdlib.h>
 #include <string.h>
 #include "bus1-client.h"
 #include "org.bus1/b1-peer.h"
+#include "trace.h"
 
 struct B1ReplySlot {
-        char *type_input;
+        B1Signature *signature_input;
         B1Node *reply_node;
         B1ReplySlotFn fn;
         void *userdata;
+
+        B1Handle *credit_handle;
+        uint64_t credit_bytes;
 };
 
+static int b1_reply_slot_return_credits(B1ReplySlot *slot) {
+        B1Handle *handle = slot->credit_handle;
+        int r;
+
+        if (!handle)
+                return 0;
+
+        slot->credit_handle = NULL;
+
+        handle->credits.n_bytes += slot->credit_bytes;
+        handle->credits.n_messages += 1;
+
+        r = b1_message_flush_credits(handle);
+        b1_handle_unref(handle);
+
+        return r;
+}
+
 /**
  * b1_reply_slot_free() - unregister and free slot
  * @slot:               a slot, or NULL
@@ -43,7 +67,12 @@ struct B1ReplySlot {
  * Return: NULL.
  */
 _c_public_ B1ReplySlot *b1_reply_slot_free(B1ReplySlot *slot) {
+        if (!slot)
+                return NULL;
+
+        (void)b1_reply_slot_return_credits(slot);
         b1_node_free(slot->reply_node);
+        b1_signature_unref(slot->signature_input);
         free(slot);
 
         return NULL;
@@ -62,25 +91,31 @@ _c_public_ void *b1_reply_slot_get_userdata(B1ReplySlot *slot) {
         return b1_node_get_userdata(slot->reply_node);
 }
 
-static int b1_reply_slot_new(B1Peer *peer, B1ReplySlot **slotp, const char *type_input, B1ReplySlotFn fn, void *userdata) {
+static int b1_reply_slot_new(B1Peer *peer,
+                             B1ReplySlot **slotp,
+                             B1Signature *signature_input,
+                             B1ReplySlotFn fn,
+                             void *userdata) {
         _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
-        size_t n_type_input;
         int r;
 
         assert(slotp);
-        assert(type_input);
+        assert(signature_input);
         assert(fn);
 
-        n_type_input = strlen(type_input) + 1;
-        slot = malloc(sizeof(*slot) + n_type_input);
+        slot = malloc(sizeof(*slot));
         if (!slot)
                 return -ENOMEM;
 
-        slot->type_input = NULL;
+        slot->signature_input = NULL;
         slot->reply_node = NULL;
         slot->fn = fn;
-        slot->type_input = (void *)(slot + 1);
-        memcpy(slot->type_input, type_input, n_type_input);
+        slot->credit_handle = NULL;
+        slot->credit_bytes = 0;
+
+        r = b1_signature_ref_payload(signature_input, &slot->signature_input);
+        if (r < 0)
+                return r;
 
         r = b1_node_new(peer, &slot->reply_node, userdata);
         if (r < 0)
@@ -93,46 +128,115 @@ static int b1_reply_slot_new(B1Peer *peer, B1ReplySlot **slotp, const char *type
         return 0;
 }
 
-/**
- * b1_message_send() - send a message to the given handles
- * @message             the message to be sent
- * @handles             the destination handles
- * @n_handles           the number of handles
- *
- * Return: 0 on succes, or a negative error code on failure.
+static size_t b1_message_count_vecs(const struct iovec *vecs, size_t n_vecs, size_t threshold) {
+        size_t n = 0;
+        bool run = false;
+
+        for (size_t i = 0; i < n_vecs; ++i) {
+                if (vecs[i].iov_len < threshold) {
+                        n += !run;
+                        run = true;
+                } else {
+                        ++n;
+                        run = false;
+                }
+        }
+
+        return n;
+}
+
+/*
+ * Vectors are passed to the kernel as is, unless there are more than
+ * BUS1_VEC_MAX of them, or coalescing was enabled on the peer. Then, runs of
+ * adjacent vectors below the threshold are copied into a scratch buffer of the
+ * peer and passed as one, while larger vectors are still passed by reference.
+ * If this still exceeds the limit, the threshold is doubled until it does not.
  */
-_c_public_ int b1_message_send(B1Message *message,
-                               B1Handle **handles,
-                               size_t n_handles) {
+static int b1_message_plan_vecs(B1Peer *peer, const struct iovec **vecsp, size_t *n_vecsp) {
+        const struct iovec *vecs = *vecsp;
+        size_t n_vecs = *n_vecsp, threshold = peer->coalesce.threshold;
+        size_t n_bytes = 0, n = 0, i, j;
+        uint8_t *p;
+
+        if (_c_likely_(n_vecs <= BUS1_VEC_MAX && (!threshold || n_vecs < 2)))
+                return 0;
+
+        threshold = c_max(threshold, (size_t)1);
+        while (b1_message_count_vecs(vecs, n_vecs, threshold) > BUS1_VEC_MAX)
+                threshold *= 2;
+
+        /* only runs of at least two vectors are copied */
+        for (i = 0; i < n_vecs; i = j) {
+                for (j = i + 1; vecs[i].iov_len < threshold && j < n_vecs && vecs[j].iov_len < threshold; ++j)
+                        n_bytes += vecs[j].iov_len;
+                if (j - i > 1)
+                        n_bytes += vecs[i].iov_len;
+        }
+
+        if (!peer->coalesce.vecs) {
+                peer->coalesce.vecs = malloc(BUS1_VEC_MAX * sizeof(*peer->coalesce.vecs));
+                if (!peer->coalesce.vecs)
+                        return -ENOMEM;
+        }
+
+        if (n_bytes > peer->coalesce.n_buffer) {
+                p = realloc(peer->coalesce.buffer, n_bytes);
+                if (!p)
+                        return -ENOMEM;
+
+                peer->coalesce.buffer = p;
+                peer->coalesce.n_buffer = n_bytes;
+        }
+
+        p = peer->coalesce.buffer;
+        for (i = 0; i < n_vecs; i = j) {
+                for (j = i + 1; vecs[i].iov_len < threshold && j < n_vecs && vecs[j].iov_len < threshold; ++j)
+                        ;
+
+                if (j - i == 1) {
+                        peer->coalesce.vecs[n++] = vecs[i];
+                        continue;
+                }
+
+                peer->coalesce.vecs[n].iov_base = p;
+                for (size_t k = i; k < j; ++k)
+                        p = mempcpy(p, vecs[k].iov_base, vecs[k].iov_len);
+                peer->coalesce.vecs[n].iov_len = p - (uint8_t *)peer->coalesce.vecs[n].iov_base;
+                ++n;
+        }
+
+        peer->coalesce.n_bytes += n_bytes;
+
+        *vecsp = peer->coalesce.vecs;
+        *n_vecsp = n;
+        return 0;
+}
+
+static int b1_message_send_vecs(B1Message *message,
+                                B1Handle **handles,
+                                size_t n_handles,
+                                const struct iovec *vecs,
+                                size_t n_vecs,
+                                uint64_t *send_timep) {
         /* limit number of destinations? */
         uint64_t destinations[n_handles];
         uint64_t *handle_ids;
-        size_t n_vecs;
         struct bus1_cmd_send send = {
                 .ptr_destinations = (uintptr_t)destinations,
                 .n_destinations = n_handles,
         };
         int r;
 
-        assert(!n_handles || handles);
-
-        if (!message || message->type == B1_MESSAGE_TYPE_NODE_DESTROY)
-                return -EINVAL;
-
         if (message->type == B1_MESSAGE_TYPE_SEED) {
                 send.flags = BUS1_SEND_FLAG_SILENT | BUS1_SEND_FLAG_SEED;
                 if (n_handles)
                         return -EINVAL;
         }
 
-        b1_message_seal(message);
-
         handle_ids = malloc(sizeof(uint64_t) * message->data.n_handles);
         if (!handle_ids)
                 return -ENOMEM;
 
-        send.ptr_vecs = (uintptr_t)c_variant_get_vecs(message->data.cv, &n_vecs);
-        send.n_vecs = n_vecs;
         send.ptr_handles = (uintptr_t)handle_ids;
         send.n_handles = message->data.n_handles;
         send.ptr_fds = (uintptr_t)message->data.fds;
@@ -164,6 +268,17 @@ _c_public_ int b1_message_send(B1Message *message,
                 destinations[i] = handles[i]->id;
         }
 
+        /* the timestamp may be among the vectors that get copied */
+        if (send_timep)
+                *send_timep = b1_now_nsec();
+
+        r = b1_message_plan_vecs(message->peer, &vecs, &n_vecs);
+        if (r < 0)
+                goto error;
+
+        send.ptr_vecs = (uintptr_t)vecs;
+        send.n_vecs = n_vecs;
+
         r = bus1_client_send(message->peer->client, &send);
         if (r < 0)
                 goto error;
@@ -204,12 +319,321 @@ error:
                         handle->marked = false;
         }
 
+        return r;
+}
+
+/*
+ * With send timestamps enabled, the type is sent with B1_MESSAGE_FLAG_SEND_TIME
+ * set, and the time of sending is appended to the message. Both are passed as
+ * separate vectors, so the sealed message itself is left untouched and can be
+ * sent again.
+ */
+static int b1_message_send_stamped(B1Message *message,
+                                   B1Handle **handles,
+                                   size_t n_handles,
+                                   const struct iovec *vecs,
+                                   size_t n_vecs) {
+        struct iovec stamped_vecs[n_vecs + 2];
+        uint64_t type, send_time;
+
+        type = message->type | B1_MESSAGE_FLAG_SEND_TIME;
+
+        stamped_vecs[0].iov_base = &type;
+        stamped_vecs[0].iov_len = sizeof(type);
+        stamped_vecs[1].iov_base = (uint8_t *)vecs[0].iov_base + sizeof(type);
+        stamped_vecs[1].iov_len = vecs[0].iov_len - sizeof(type);
+        memcpy(stamped_vecs + 2, vecs + 1, (n_vecs - 1) * sizeof(*vecs));
+        stamped_vecs[n_vecs + 1].iov_base = &send_time;
+        stamped_vecs[n_vecs + 1].iov_len = sizeof(send_time);
+
+        return b1_message_send_vecs(message, handles, n_handles,
+                                    stamped_vecs, n_vecs + 2, &send_time);
+}
+
+/*
+ * With an attachment, the type is sent with B1_MESSAGE_FLAG_ATTACHMENT set.
+ * The attached vectors follow the envelope, which is padded to 8 bytes, and
+ * are referenced rather than copied. A trailer with the sizes of the envelope
+ * and the attachment is appended, followed by the send timestamp, if enabled.
+ */
+static int b1_message_send_attached(B1Message *message,
+                                    B1Handle **handles,
+                                    size_t n_handles,
+                                    const struct iovec *vecs,
+                                    size_t n_vecs) {
+        struct iovec attached_vecs[n_vecs + message->data.attachment.n_vecs + 4];
+        static const uint64_t padding;
+        uint64_t type, trailer[2], send_time;
+        size_t n = 0;
+
+        if (n_vecs < 1 || vecs[0].iov_len < sizeof(type))
+                return -EINVAL;
+
+        type = message->type | B1_MESSAGE_FLAG_ATTACHMENT;
+        trailer[0] = 0;
+        trailer[1] = message->data.attachment.n_bytes;
+
+        for (size_t i = 0; i < n_vecs; ++i)
+                trailer[0] += vecs[i].iov_len;
+
+        attached_vecs[n].iov_base = &type;
+        attached_vecs[n++].iov_len = sizeof(type);
+        attached_vecs[n].iov_base = (uint8_t *)vecs[0].iov_base + sizeof(type);
+        attached_vecs[n++].iov_len = vecs[0].iov_len - sizeof(type);
+        memcpy(attached_vecs + n, vecs + 1, (n_vecs - 1) * sizeof(*vecs));
+        n += n_vecs - 1;
+
+        if (c_align_to(trailer[0], 8) > trailer[0]) {
+                attached_vecs[n].iov_base = (void *)&padding;
+                attached_vecs[n++].iov_len = c_align_to(trailer[0], 8) - trailer[0];
+        }
+
+        memcpy(attached_vecs + n, message->data.attachment.vecs,
+               message->data.attachment.n_vecs * sizeof(*vecs));
+        n += message->data.attachment.n_vecs;
+
+        attached_vecs[n].iov_base = trailer;
+        attached_vecs[n++].iov_len = sizeof(trailer);
+
+        if (!message->peer->send_timestamps || message->type == B1_MESSAGE_TYPE_SEED)
+                return b1_message_send_vecs(message, handles, n_handles,
+                                            attached_vecs, n, NULL);
+
+        type |= B1_MESSAGE_FLAG_SEND_TIME;
+        attached_vecs[n].iov_base = &send_time;
+        attached_vecs[n++].iov_len = sizeof(send_time);
+
+        return b1_message_send_vecs(message, handles, n_handles,
+                                    attached_vecs, n, &send_time);
+}
+
+static int b1_message_send_internal(B1Message *message,
+                                    B1Handle **handles,
+                                    size_t n_handles) {
+        const struct iovec *vecs;
+        size_t n_vecs;
+
+        b1_message_seal(message);
+
+        vecs = c_variant_get_vecs(message->data.cv, &n_vecs);
+
+        if (message->data.attachment.vecs)
+                return b1_message_send_attached(message, handles, n_handles, vecs, n_vecs);
+
+        /* the type is the leading 't' of the envelope */
+        if (_c_unlikely_(message->peer->send_timestamps) &&
+            message->type != B1_MESSAGE_TYPE_SEED &&
+            n_vecs > 0 && vecs[0].iov_len >= sizeof(uint64_t))
+                return b1_message_send_stamped(message, handles, n_handles, vecs, n_vecs);
+
+        return b1_message_send_vecs(message, handles, n_handles, vecs, n_vecs, NULL);
+}
+
+static B1ReplySlot *b1_message_get_reply_slot(B1Message *message) {
+        B1Handle *reply_handle;
+
+        reply_handle = b1_message_get_reply_handle(message);
+        if (!reply_handle || !reply_handle->node)
+                return NULL;
+
+        return reply_handle->node->slot;
+}
+
+static uint64_t b1_message_get_size(B1Message *message) {
+        const struct iovec *vecs;
+        uint64_t n_bytes = 0;
+        size_t n_vecs;
+
+        vecs = c_variant_get_vecs(message->data.cv, &n_vecs);
+        for (size_t i = 0; i < n_vecs; i++)
+                n_bytes += vecs[i].iov_len;
+
+        if (message->data.attachment.vecs)
+                n_bytes = c_align_to(n_bytes, 8) +
+                          message->data.attachment.n_bytes +
+                          2 * sizeof(uint64_t);
+
+        return n_bytes;
+}
+
+static bool b1_handle_has_credits(B1Handle *handle, uint64_t n_bytes) {
+        return handle->credits.n_messages > 0 &&
+               handle->credits.n_bytes >= n_bytes;
+}
+
+static int b1_message_send_credited(B1Message *message, B1Handle *handle, uint64_t n_bytes) {
+        B1ReplySlot *slot;
+        int r;
+
+        slot = b1_message_get_reply_slot(message);
+        if (handle->credits.policy == B1_CREDIT_POLICY_NONE ||
+            !slot || slot->credit_handle)
+                return b1_message_send_internal(message, &handle, 1);
+
+        r = b1_message_send_internal(message, &handle, 1);
+        if (r < 0)
+                return r;
+
+        handle->credits.n_bytes -= n_bytes;
+        handle->credits.n_messages -= 1;
+
+        slot->credit_handle = b1_handle_ref(handle);
+        slot->credit_bytes = n_bytes;
+
+        return 0;
+}
+
+/*
+ * Report a queued message that could not be sent to its reply slot, as if the
+ * destination had replied with an org.bus1.Error.Errno error. The caller of
+ * b1_message_send() has already been told the message was accepted, so this
+ * is the only place the failure can surface.
+ */
+static int b1_reply_slot_fail(B1ReplySlot *slot, B1Peer *peer, unsigned int err) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        int r;
+
+        r = b1_message_new_error(peer, &message, "org.bus1.Error.Errno", "u");
+        if (r < 0)
+                return r;
+
+        r = b1_message_write(message, "u", err);
+        if (r < 0)
+                return r;
+
+        r = b1_message_seal(message);
+        if (r < 0)
+                return r;
+
+        return slot->fn(slot, b1_node_get_userdata(slot->reply_node), message);
+}
+
+int b1_message_flush_credits(B1Handle *handle) {
+        B1CreditEntry *entry;
+        B1ReplySlot *slot;
+        int r = 0, k;
+
+        assert(handle);
+
+        while ((entry = handle->credits.queue)) {
+                slot = b1_message_get_reply_slot(entry->message);
+
+                /* messages without a reply slot only wait for those ahead of them */
+                if (handle->credits.policy != B1_CREDIT_POLICY_NONE && slot &&
+                    !b1_handle_has_credits(handle, entry->n_bytes))
+                        break;
+
+                handle->credits.queue = entry->next;
+                if (!handle->credits.queue)
+                        handle->credits.queue_tail = &handle->credits.queue;
+
+                k = b1_message_send_credited(entry->message, handle, entry->n_bytes);
+                if (k < 0 && slot)
+                        k = b1_reply_slot_fail(slot, handle->holder, -k);
+                if (k < 0 && r == 0)
+                        r = k;
+
+                b1_message_unref(entry->message);
+                free(entry);
+        }
+
+        return r;
+}
+
+static int b1_message_queue_credited(B1Message *message, B1Handle *handle, uint64_t n_bytes) {
+        B1CreditEntry *entry;
+
+        entry = calloc(1, sizeof(*entry));
+        if (!entry)
+                return -ENOMEM;
+
+        entry->message = b1_message_ref(message);
+        entry->n_bytes = n_bytes;
+
+        *handle->credits.queue_tail = entry;
+        handle->credits.queue_tail = &entry->next;
+
         return 0;
 }
 
+static int b1_message_send_flow(B1Message *message,
+                                B1Handle **handles,
+                                size_t n_handles) {
+        B1Handle *handle;
+        uint64_t n_bytes;
+        int r;
+
+        if (n_handles != 1 || handles[0]->credits.policy == B1_CREDIT_POLICY_NONE)
+                return b1_message_send_internal(message, handles, n_handles);
+
+        handle = handles[0];
+
+        if (!b1_message_is_sealed(message)) {
+                r = b1_message_seal(message);
+                if (r < 0)
+                        return r;
+        }
+
+        n_bytes = b1_message_get_size(message);
+
+        /* nothing may overtake queued messages, or they would be reordered */
+        if (!handle->credits.queue &&
+            (!b1_message_get_reply_slot(message) || b1_handle_has_credits(handle, n_bytes)))
+                return b1_message_send_credited(message, handle, n_bytes);
+        else if (handle->credits.policy == B1_CREDIT_POLICY_REJECT)
+                return -EAGAIN;
+
+        return b1_message_queue_credited(message, handle, n_bytes);
+}
+
+/**
+ * b1_message_send() - send a message to the given handles
+ * @message             the message to be sent
+ * @handles             the destination handles
+ * @n_handles           the number of handles
+ *
+ * If the message is sent to a single handle with flow control enabled, it is
+ * subject to the credits of that handle. See b1_handle_set_credits() for
+ * details.
+ *
+ * Return: 0 on succes, or a negative error code on failure.
+ */
+_c_public_ int b1_message_send(B1Message *message,
+                               B1Handle **handles,
+                               size_t n_handles) {
+        void *context;
+        int r;
+
+        assert(!n_handles || handles);
+
+        if (!message || message->type == B1_MESSAGE_TYPE_NODE_DESTROY)
+                return -EINVAL;
+
+        B1_TRACE(send_entry, message, message->type, n_handles);
+
+        if (_c_unlikely_(message->peer->hooked)) {
+                context = b1_peer_hook_begin(message->peer, B1_HOOK_SEND, message);
+                r = b1_message_send_flow(message, handles, n_handles);
+                b1_peer_hook_end(message->peer, B1_HOOK_SEND, message, context, r);
+        } else {
+                r = b1_message_send_flow(message, handles, n_handles);
+        }
+
+        B1_TRACE(send_exit, message, r,
+                 B1_TRACE_ENABLED(send_exit) && r >= 0 ? b1_message_get_size(message) : 0);
+
+        if (_c_unlikely_(message->peer->recorder))
+                b1_recorder_record(message->peer->recorder, B1_RECORD_SEND, message,
+                                   n_handles > 0 ? handles[0]->id : 0,
+                                   r < 0 ? 0 : b1_message_get_size(message),
+                                   0, r);
+
+        return r;
+}
+
 int b1_message_new_from_slice(B1Message **messagep, B1Peer *peer, void *slice, size_t n_bytes) {
         _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
-        const struct iovec vec = {
+        struct iovec vec = {
                 .iov_base = slice,
                 .iov_len = n_bytes,
         };
@@ -225,6 +649,34 @@ int b1_message_new_from_slice(B1Message **messagep, B1Peer *peer, void *slice, s
         message->peer = b1_peer_ref(peer);
         message->data.slice = slice;
 
+        /* strip the send timestamp, if the sender appended one */
+        if (n_bytes >= 2 * sizeof(uint64_t) &&
+            (*(uint64_t *)slice & B1_MESSAGE_FLAG_SEND_TIME)) {
+                vec.iov_len -= sizeof(uint64_t);
+                memcpy(&message->data.send_time, (uint8_t *)slice + vec.iov_len, sizeof(uint64_t));
+        }
+
+        /* strip the attachment and its trailer, if the sender appended one */
+        if (vec.iov_len >= 3 * sizeof(uint64_t) &&
+            (*(uint64_t *)slice & B1_MESSAGE_FLAG_ATTACHMENT)) {
+                uint64_t trailer[2];
+
+                vec.iov_len -= sizeof(trailer);
+                memcpy(trailer, (uint8_t *)slice + vec.iov_len, sizeof(trailer));
+
+                /* both sizes are chosen by the sender, so avoid any overflow */
+                if (trailer[0] < sizeof(uint64_t) || trailer[0] > vec.iov_len ||
+                    c_align_to(trailer[0], 8) > vec.iov_len ||
+                    trailer[1] != vec.iov_len - c_align_to(trailer[0], 8))
+                        return -EBADMSG;
+
+                message->data.attachment.data = (uint8_t *)slice + c_align_to(trailer[0], 8);
+                message->data.attachment.n_bytes = trailer[1];
+                vec.iov_len = trailer[0];
+        }
+
+        message->data.n_envelope = vec.iov_len;
+
         r = c_variant_new_from_vecs(&message->data.cv,
                                     "(tvv)", strlen("(tvv)"),
                                     &vec, 1);
@@ -237,6 +689,146 @@ int b1_message_new_from_slice(B1Message **messagep, B1Peer *peer, void *slice, s
         return 0;
 }
 
+/*
+ * Parse the envelope of a message created via b1_message_new_from_slice(). The
+ * handles of the message must already be set up, as the header refers to them
+ * by index. On success, the message is positioned at the start of the payload.
+ * This is kept separate from the receive path, so it can be exercised without
+ * a kernel.
+ */
+int b1_message_parse_header(B1Message *message) {
+        unsigned int reply_handle;
+        int r;
+
+        assert(message);
+
+        r = c_variant_enter(message->data.cv, "(");
+        if (r < 0)
+                return r;
+
+        r = c_variant_read(message->data.cv, "t", &message->type);
+        if (r < 0)
+                return r;
+
+        message->type &= ~B1_MESSAGE_FLAGS;
+
+        switch (message->type) {
+        case B1_MESSAGE_TYPE_CALL:
+                r = c_variant_enter(message->data.cv, "v(");
+                if (r < 0)
+                        return r;
+
+                r = c_variant_read(message->data.cv, "ss",
+                                   &message->data.call.interface,
+                                   &message->data.call.member);
+                if (r < 0)
+                        return r;
+
+                r = c_variant_enter(message->data.cv, "m");
+                if (r < 0)
+                        return r;
+
+                r = c_variant_peek_count(message->data.cv);
+                if (r < 0)
+                        return r;
+                else if (r == 1) {
+                        r = c_variant_read(message->data.cv, "u", &reply_handle);
+                        if (r < 0)
+                                return r;
+
+                        if (message->data.n_handles <= reply_handle)
+                                return -EIO;
+
+                        message->data.call.reply_handle = message->data.handles[reply_handle];
+                } else
+                        message->data.call.reply_handle = NULL;
+
+                r = c_variant_exit(message->data.cv, "m)v");
+
+                break;
+
+        case B1_MESSAGE_TYPE_REPLY:
+                r = c_variant_enter(message->data.cv, "vm");
+                if (r < 0)
+                        return r;
+
+                r = c_variant_peek_count(message->data.cv);
+                if (r < 0)
+                        return r;
+                else if (r == 1) {
+                        r = c_variant_read(message->data.cv, "u", &reply_handle);
+                        if (r < 0)
+                                return r;
+
+                        if (message->data.n_handles <= reply_handle)
+                                return -EIO;
+
+                        message->data.reply.reply_handle = message->data.handles[reply_handle];
+                } else
+                        message->data.reply.reply_handle = NULL;
+
+                r = c_variant_exit(message->data.cv, "mv");
+
+                break;
+
+        case B1_MESSAGE_TYPE_ERROR:
+                r = c_variant_read(message->data.cv, "v", "s", &message->data.error.name);
+                if (r < 0)
+                        return r;
+
+                break;
+
+        case B1_MESSAGE_TYPE_SEED:
+                r = c_variant_enter(message->data.cv, "va");
+                if (r < 0)
+                        return r;
+
+                r = c_variant_peek_count(message->data.cv);
+                if (r < 0)
+                        return r;
+
+                message->data.seed.root_nodes = (CRBTree){};
+
+                for (unsigned i = 0, n = r; i < n; i ++) {
+                        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+                        const char *name;
+                        unsigned int offset;
+                        CRBNode **slot, *p;
+
+                        r = c_variant_read(message->data.cv, "(su)", &name, &offset);
+                        if (r < 0)
+                                return r;
+
+                        slot = c_rbtree_find_slot(&message->data.seed.root_nodes,
+                                                  root_nodes_compare, name, &p);
+                        if (!slot)
+                                return -EIO;
+
+                        r = b1_node_new_internal(message->peer, &node, NULL,
+                                                 message->data.handles[offset]->id, name);
+                        if (r < 0)
+                                return r;
+
+                        node->handle = b1_handle_ref(message->data.handles[offset]);
+
+                        c_rbtree_add(&message->data.seed.root_nodes, p, slot, &node->rb);
+
+                        node = NULL;
+                }
+
+                break;
+
+        default:
+                return -EIO;
+        }
+
+        r = c_variant_enter(message->data.cv, "v");
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
 _c_public_ int b1_message_append_handle(B1Message *message, B1Handle *handle) {
         B1Handle **handles;
 
@@ -310,13 +902,67 @@ static int b1_message_new(B1Peer *peer, B1Message **messagep, unsigned int type)
         if (r < 0)
                 return r;
 
-        r = c_variant_begin(message->data.cv, "(");
+        r = c_variant_begin(message->data.cv, "(");
+        if (r < 0)
+                return r;
+
+        r = c_variant_write(message->data.cv, "t", type);
+        if (r < 0)
+                return r;
+
+        *messagep = message;
+        message = NULL;
+
+        return 0;
+}
+
+static int b1_message_new_call_internal(B1Peer *peer,
+                                        B1Message **messagep,
+                                        const char *interface,
+                                        const char *member,
+                                        const char *signature_input,
+                                        B1Signature *signature_output,
+                                        B1ReplySlot **slotp,
+                                        B1ReplySlotFn fn,
+                                        void *userdata) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
+        int r;
+
+        r = b1_message_new(peer, &message, B1_MESSAGE_TYPE_CALL);
+        if (r < 0)
+                return r;
+
+        if (slotp) {
+                r = b1_reply_slot_new(peer, &slot, signature_output, fn, userdata);
+                if (r < 0)
+                        return r;
+
+                r = b1_message_append_handle(message, slot->reply_node->handle);
+                if (r < 0)
+                        return r;
+
+                message->data.call.reply_handle = slot->reply_node->handle;
+
+                /* <interface, member, reply handle> */
+                r = c_variant_write(message->data.cv, "v", "(ssmu)", interface, member, true, r);
+                if (r < 0)
+                        return r;
+        } else {
+                /* <interface, member, nothing> */
+                r = c_variant_write(message->data.cv, "v", "(ssmu)", interface, member, false);
+                if (r < 0)
+                        return r;
+        }
+
+        r = c_variant_begin(message->data.cv, "v", signature_input);
         if (r < 0)
                 return r;
 
-        r = c_variant_write(message->data.cv, "t", type);
-        if (r < 0)
-                return r;
+        if (slotp) {
+                *slotp = slot;
+                slot = NULL;
+        }
 
         *messagep = message;
         message = NULL;
@@ -349,11 +995,32 @@ _c_public_ int b1_message_new_call(B1Peer *peer,
                                    B1ReplySlot **slotp,
                                    B1ReplySlotFn fn,
                                    void *userdata) {
+        _c_cleanup_(b1_signature_unrefp) B1Signature *signature = NULL;
+        int r;
+
+        if (slotp) {
+                r = b1_signature_new(&signature, signature_output);
+                if (r < 0)
+                        return r;
+        }
+
+        return b1_message_new_call_internal(peer, messagep, interface, member,
+                                            signature_input, signature,
+                                            slotp, fn, userdata);
+}
+
+static int b1_message_new_reply_internal(B1Peer *peer,
+                                         B1Message **messagep,
+                                         const char *signature_input,
+                                         B1Signature *signature_output,
+                                         B1ReplySlot **slotp,
+                                         B1ReplySlotFn fn,
+                                         void *userdata) {
         _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
         _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
         int r;
 
-        r = b1_message_new(peer, &message, B1_MESSAGE_TYPE_CALL);
+        r = b1_message_new(peer, &message, B1_MESSAGE_TYPE_REPLY);
         if (r < 0)
                 return r;
 
@@ -366,13 +1033,15 @@ _c_public_ int b1_message_new_call(B1Peer *peer,
                 if (r < 0)
                         return r;
 
-                /* <interface, member, reply handle> */
-                r = c_variant_write(message->data.cv, "v", "(ssmu)", interface, member, true, r);
+                message->data.reply.reply_handle = slot->reply_node->handle;
+
+                /* <reply handle> */
+                r = c_variant_write(message->data.cv, "v", "mu", true, r);
                 if (r < 0)
                         return r;
         } else {
-                /* <interface, member, nothing> */
-                r = c_variant_write(message->data.cv, "v", "(ssmu)", interface, member, false);
+                /* <nothing> */
+                r = c_variant_write(message->data.cv, "v", "mu", false);
                 if (r < 0)
                         return r;
         }
@@ -413,47 +1082,17 @@ _c_public_ int b1_message_new_reply(B1Peer *peer,
                                     B1ReplySlot **slotp,
                                     B1ReplySlotFn fn,
                                     void *userdata) {
-        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
-        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
+        _c_cleanup_(b1_signature_unrefp) B1Signature *signature = NULL;
         int r;
 
-        r = b1_message_new(peer, &message, B1_MESSAGE_TYPE_REPLY);
-        if (r < 0)
-                return r;
-
         if (slotp) {
-                r = b1_reply_slot_new(peer, &slot, signature_output, fn, userdata);
-                if (r < 0)
-                        return r;
-
-                r = b1_message_append_handle(message, slot->reply_node->handle);
-                if (r < 0)
-                        return r;
-
-                /* <reply handle> */
-                r = c_variant_write(message->data.cv, "v", "mu", true, r);
-                if (r < 0)
-                        return r;
-        } else {
-                /* <nothing> */
-                r = c_variant_write(message->data.cv, "v", "mu", false);
+                r = b1_signature_new(&signature, signature_output);
                 if (r < 0)
                         return r;
         }
 
-        r = c_variant_begin(message->data.cv, "v", signature_input);
-        if (r < 0)
-                return r;
-
-        if (slotp) {
-                *slotp = slot;
-                slot = NULL;
-        }
-
-        *messagep = message;
-        message = NULL;
-
-        return 0;
+        return b1_message_new_reply_internal(peer, messagep, signature_input, signature,
+                                             slotp, fn, userdata);
 }
 
 /**
@@ -489,6 +1128,77 @@ _c_public_ int b1_message_new_error(B1Peer *peer, B1Message **messagep, const ch
         return 0;
 }
 
+/**
+ * b1_message_new_call_signature() - create new method call
+ * @messagep:           pointer to the new message object
+ * @interface:          the interface to call on
+ * @member:             the member of the interface
+ * @signature_input:    the compiled type of the payload
+ * @signature_output:   the compiled type of the reply payload
+ * @slotp:              pointer to a new reply object, or NULL
+ * @fn:                 the reply handler, or NULL
+ * @userdata:           the userdata to pass to the reply handler, or NULL
+ *
+ * This is b1_message_new_call(), but with compiled signatures.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_message_new_call_signature(B1Peer *peer,
+                                             B1Message **messagep,
+                                             const char *interface,
+                                             const char *member,
+                                             B1Signature *signature_input,
+                                             B1Signature *signature_output,
+                                             B1ReplySlot **slotp,
+                                             B1ReplySlotFn fn,
+                                             void *userdata) {
+        return b1_message_new_call_internal(peer, messagep, interface, member,
+                                            signature_input->string, signature_output,
+                                            slotp, fn, userdata);
+}
+
+/**
+ * b1_message_new_reply_signature() - create a new method reply
+ * @messagep:           the new message object
+ * @signature_input:    the compiled type of the payload
+ * @signature_output:   the compiled type of the reply payload
+ * @slotp:              pointer to a new reply object, or NULL
+ * @fn:                 the reply handler, or NULL
+ * @userdata:           the userdata to pass to the reply handler, or NULL
+ *
+ * This is b1_message_new_reply(), but with compiled signatures.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_message_new_reply_signature(B1Peer *peer,
+                                              B1Message **messagep,
+                                              B1Signature *signature_input,
+                                              B1Signature *signature_output,
+                                              B1ReplySlot **slotp,
+                                              B1ReplySlotFn fn,
+                                              void *userdata) {
+        return b1_message_new_reply_internal(peer, messagep,
+                                             signature_input->string, signature_output,
+                                             slotp, fn, userdata);
+}
+
+/**
+ * b1_message_new_error_signature() - create a new method error reply
+ * @messagep:           the new message object
+ * @name:               the error name
+ * @signature:          the compiled type of the payload
+ *
+ * This is b1_message_new_error(), but with a compiled signature.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_message_new_error_signature(B1Peer *peer,
+                                              B1Message **messagep,
+                                              const char *name,
+                                              B1Signature *signature) {
+        return b1_message_new_error(peer, messagep, name, signature->string);
+}
+
 static int strcmpuniq(const void *ap, const void *bp, void *userdata) {
         const char *a = * (char * const *) ap;
         const char *b = * (char * const *) bp;
@@ -597,6 +1307,10 @@ _c_public_ B1Message *b1_message_unref(B1Message *message) {
 
         if (message->type != B1_MESSAGE_TYPE_NODE_DESTROY) {
                 c_variant_free(message->data.cv);
+                free(message->data.attachment.vecs);
+
+                if (message->data.attachment.release_fn)
+                        message->data.attachment.release_fn(message->data.attachment.userdata);
 
                 for (unsigned int i = 0; i < message->data.n_handles; i++)
                         b1_handle_unref(message->data.handles[i]);
@@ -607,6 +1321,12 @@ _c_public_ B1Message *b1_message_unref(B1Message *message) {
                         close(message->data.fds[i]);
 
                 if (message->data.slice) {
+                        B1_TRACE(slice_release,
+                                 bus1_client_slice_to_offset(message->peer->client, message->data.slice),
+                                 message->data.n_slice);
+                        /* messages that failed to parse were never linked */
+                        if (message->data.pool_linked)
+                                b1_peer_pool_unlink(message->peer, message);
                         bus1_client_slice_release(message->peer->client,
                                 bus1_client_slice_to_offset(message->peer->client,
                                                             message->data.slice));
@@ -693,103 +1413,259 @@ static int b1_message_dispatch_node_destroy(B1Message *message) {
         return r;
 }
 
-static int b1_message_reply_error(B1Message *origin, const char *name) {
-        _c_cleanup_(b1_message_unrefp) B1Message *error = NULL;
+enum {
+        B1_MESSAGE_ERROR_NODE_DESTROYED,
+        B1_MESSAGE_ERROR_MISSING_ROOT_INTERFACE,
+        B1_MESSAGE_ERROR_INVALID_INTERFACE,
+        B1_MESSAGE_ERROR_INVALID_MEMBER,
+        B1_MESSAGE_ERROR_INVALID_SIGNATURE,
+        B1_MESSAGE_ERROR_INVALID_NODE,
+        B1_MESSAGE_ERROR_INVALID_MESSAGE_TYPE,
+        _B1_MESSAGE_ERROR_N,
+};
+
+static const char * const b1_message_error_names[_B1_MESSAGE_ERROR_N] = {
+        [B1_MESSAGE_ERROR_NODE_DESTROYED] = "org.bus1.Error.NodeDestroyed",
+        [B1_MESSAGE_ERROR_MISSING_ROOT_INTERFACE] = "org.bus1.Error.MissingRootInterface",
+        [B1_MESSAGE_ERROR_INVALID_INTERFACE] = "org.bus1.Error.InvalidInterface",
+        [B1_MESSAGE_ERROR_INVALID_MEMBER] = "org.bus1.Error.InvalidMember",
+        [B1_MESSAGE_ERROR_INVALID_SIGNATURE] = "org.bus1.Error.InvalidSignature",
+        [B1_MESSAGE_ERROR_INVALID_NODE] = "org.bus1.Error.InvalidNode",
+        [B1_MESSAGE_ERROR_INVALID_MESSAGE_TYPE] = "org.bus1.Error.InvalidMessageType",
+};
+
+/*
+ * The error replies generated by the library carry no reference to the call
+ * they reply to, so each is built and sealed once per peer and then sent as
+ * is, to any number of destinations. Errors tend to come in bursts, when a
+ * node dies or a client misbehaves, and this keeps them cheap.
+ *
+ * Cached messages can be held by send hooks or queued for credits beyond the
+ * peer, so they keep their reference to it. The peer counts these references,
+ * and drops its cache once they are the only ones left, see b1_peer_unref().
+ */
+struct B1MessageErrors {
+        B1Message *names[_B1_MESSAGE_ERROR_N];
+        B1Message *errnos[B1_MESSAGE_ERRNO_MAX];
+};
+
+void b1_message_errors_free(B1MessageErrors *errors) {
+        if (!errors)
+                return;
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(errors->names); ++i)
+                b1_message_unref(errors->names[i]);
+        for (size_t i = 0; i < C_ARRAY_SIZE(errors->errnos); ++i)
+                b1_message_unref(errors->errnos[i]);
+
+        free(errors);
+}
+
+static B1Message **b1_message_get_cache(B1Peer *peer, unsigned int error, unsigned int err) {
+        if (!peer->errors) {
+                peer->errors = calloc(1, sizeof(*peer->errors));
+                if (!peer->errors)
+                        return NULL;
+        }
+
+        if (error < _B1_MESSAGE_ERROR_N)
+                return &peer->errors->names[error];
+        else if (err < B1_MESSAGE_ERRNO_MAX)
+                return &peer->errors->errnos[err];
+
+        return NULL;
+}
+
+static int b1_message_cache(B1Message **cachep, B1Message *message) {
+        int r;
+
+        r = b1_message_seal(message);
+        if (r < 0)
+                return r;
+
+        *cachep = b1_message_ref(message);
+        ++message->peer->n_cached;
+
+        return 0;
+}
+
+static int b1_message_reply_error(B1Message *origin, unsigned int error) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
         B1Handle *reply_handle;
+        B1Message **cachep;
         int r;
 
         reply_handle = b1_message_get_reply_handle(origin);
         if (!reply_handle)
                 return 0;
 
-        r = b1_message_new_error(origin->peer, &error, name, NULL);
+        cachep = b1_message_get_cache(origin->peer, error, 0);
+        if (cachep && *cachep)
+                return b1_message_send(*cachep, &reply_handle, 1);
+
+        r = b1_message_new_error(origin->peer, &message, b1_message_error_names[error], NULL);
         if (r < 0)
                 return r;
 
-        return b1_message_send(error, &reply_handle, 1);
+        if (cachep) {
+                r = b1_message_cache(cachep, message);
+                if (r < 0)
+                        return r;
+        }
+
+        return b1_message_send(message, &reply_handle, 1);
 }
 
 static int b1_message_reply_errno(B1Message *origin, unsigned int err) {
-        _c_cleanup_(b1_message_unrefp) B1Message *error = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
         B1Handle *reply_handle;
+        B1Message **cachep;
         int r;
 
         reply_handle = b1_message_get_reply_handle(origin);
         if (!reply_handle)
                 return 0;
 
-        r = b1_message_new_error(origin->peer, &error, "org.bus1.Error.Errno", "u");
+        cachep = b1_message_get_cache(origin->peer, _B1_MESSAGE_ERROR_N, err);
+        if (cachep && *cachep)
+                return b1_message_send(*cachep, &reply_handle, 1);
+
+        r = b1_message_new_error(origin->peer, &message, "org.bus1.Error.Errno", "u");
         if (r < 0)
                 return r;
 
-        r = b1_message_write(error, "u", err);
+        r = b1_message_write(message, "u", err);
         if (r < 0)
                 return r;
 
-        return b1_message_send(error, &reply_handle, 1);
+        if (cachep) {
+                r = b1_message_cache(cachep, message);
+                if (r < 0)
+                        return r;
+        }
+
+        return b1_message_send(message, &reply_handle, 1);
+}
+
+/*
+ * Check whether the payload of @message is of type @signature, as interned for
+ * a member or reply slot.
+ */
+static bool b1_message_has_signature(B1Message *message, B1Signature *signature) {
+        const char *type;
+        size_t n_type;
+
+        type = b1_message_peek_type(message, &n_type);
+
+        return type && b1_signature_matches_payload(signature, type, n_type);
 }
 
 static int b1_message_dispatch_data(B1Message *message) {
         B1Node *node;
         B1Interface *interface;
         B1Member *member;
-        const char *signature;
-        size_t signature_len;
-        int r;
+        uint64_t node_id, start = 0, end;
+        int r, k = 0;
 
         assert(message);
 
         node = b1_peer_get_node(message->peer, message->data.destination);
         if (!node)
-                return b1_message_reply_error(message, "org.bus1.Error.NodeDestroyed");
+                return b1_message_reply_error(message, B1_MESSAGE_ERROR_NODE_DESTROYED);
 
         node->live = true;
+        node_id = node->id;
 
         switch (message->type) {
         case B1_MESSAGE_TYPE_CALL:
                 interface = b1_node_get_interface(node, message->data.call.interface);
                 if (!interface) {
                         if (b1_peer_get_root_node(message->peer, message->data.call.interface))
-                                return b1_message_reply_error(message, "org.bus1.Error.MissingRootInterface");
-                        return b1_message_reply_error(message, "org.bus1.Error.InvalidInterface");
+                                return b1_message_reply_error(message, B1_MESSAGE_ERROR_MISSING_ROOT_INTERFACE);
+                        return b1_message_reply_error(message, B1_MESSAGE_ERROR_INVALID_INTERFACE);
                 }
 
                 member = b1_interface_get_member(interface, message->data.call.member);
                 if (!member)
-                        return b1_message_reply_error(message, "org.bus1.Error.InvalidMember");
+                        return b1_message_reply_error(message, B1_MESSAGE_ERROR_INVALID_MEMBER);
+
+                if (!b1_message_has_signature(message, member->signature_input))
+                        return b1_message_reply_error(message, B1_MESSAGE_ERROR_INVALID_SIGNATURE);
 
-                signature = b1_message_peek_type(message, &signature_len);
-                if (strncmp(member->type_input, signature, signature_len) != 0)
-                        return b1_message_reply_error(message, "org.bus1.Error.InvalidSignature");
+                if (_c_unlikely_(message->peer->dispatch_stats || message->peer->recorder)) {
+                        /* the member function might drop the last reference */
+                        b1_interface_ref(interface);
+                        start = b1_now_nsec();
+                }
 
+                B1_TRACE(dispatch_entry, node_id, message->data.call.interface, message->data.call.member);
                 r = member->fn(node, node->userdata, message);
+                B1_TRACE(dispatch_exit, node_id, r);
+
+                if (_c_unlikely_(start)) {
+                        end = b1_now_nsec();
+                        if (message->peer->dispatch_stats)
+                                b1_member_record(member, end - start,
+                                                 start - message->data.recv_time,
+                                                 message->data.recv_time != 0);
+                        if (message->peer->recorder)
+                                b1_recorder_record(message->peer->recorder, B1_RECORD_DISPATCH, message,
+                                                   node_id, message->data.n_slice, end - start, r);
+                        b1_interface_unref(interface);
+                }
+
                 if (r < 0)
                         return b1_message_reply_errno(message, -r);
 
                 break;
         case B1_MESSAGE_TYPE_REPLY:
                 if (!node->slot)
-                        return b1_message_reply_error(message, "org.bus1.Error.InvalidNode");
+                        return b1_message_reply_error(message, B1_MESSAGE_ERROR_INVALID_NODE);
+
+                /*
+                 * Queued messages that fail to go out are reported to their
+                 * own slots. Whatever is left is returned once the reply is
+                 * delivered.
+                 */
+                k = b1_reply_slot_return_credits(node->slot);
+
+                if (!b1_message_has_signature(message, node->slot->signature_input)) {
+                        r = b1_message_reply_error(message, B1_MESSAGE_ERROR_INVALID_SIGNATURE);
+                        return r < 0 ? r : k;
+                }
 
-                signature = b1_message_peek_type(message, &signature_len);
-                if (strncmp(node->slot->type_input, signature, signature_len) != 0)
-                        return b1_message_reply_error(message, "org.bus1.Error.InvalidSignature");
+                if (_c_unlikely_(message->peer->recorder))
+                        start = b1_now_nsec();
 
+                /* the slot may be freed by its callback, so do not touch @node after it */
+                B1_TRACE(reply_entry, node_id, message->type);
                 r = node->slot->fn(node->slot, node->userdata, message);
-                if (r < 0)
-                        return b1_message_reply_errno(message, -r);
+                B1_TRACE(reply_exit, node_id, r);
+
+                if (_c_unlikely_(start))
+                        b1_recorder_record(message->peer->recorder, B1_RECORD_DISPATCH, message,
+                                           node_id, message->data.n_slice, b1_now_nsec() - start, r);
+
+                if (r < 0) {
+                        r = b1_message_reply_errno(message, -r);
+                        return r < 0 ? r : k;
+                }
 
                 break;
         case B1_MESSAGE_TYPE_ERROR:
-                if (node->slot)
-                        (void)node->slot->fn(node->slot, node->userdata, message);
+                if (node->slot) {
+                        k = b1_reply_slot_return_credits(node->slot);
+                        B1_TRACE(reply_entry, node_id, message->type);
+                        r = node->slot->fn(node->slot, node->userdata, message);
+                        B1_TRACE(reply_exit, node_id, r);
+                }
 
                 break;
         default:
-                return b1_message_reply_error(message, "org.bus1.Error.InvalidMessageType");
+                return b1_message_reply_error(message, B1_MESSAGE_ERROR_INVALID_MESSAGE_TYPE);
         }
 
-        return 0;
+        return k;
 }
 
 static int b1_message_dispatch_seed(B1Message *message) {
@@ -808,6 +1684,15 @@ static int b1_message_dispatch_seed(B1Message *message) {
         return 0;
 }
 
+static int b1_message_dispatch_internal(B1Message *message) {
+        if (message->type == B1_MESSAGE_TYPE_NODE_DESTROY)
+                return b1_message_dispatch_node_destroy(message);
+        else if (message->type == B1_MESSAGE_TYPE_SEED)
+                return b1_message_dispatch_seed(message);
+        else
+                return b1_message_dispatch_data(message);
+}
+
 /**
  * b1_message_dispatch() - handle received message
  * @message:            the message to handle
@@ -818,14 +1703,23 @@ static int b1_message_dispatch_seed(B1Message *message) {
  * Return: 0 on success, or a negitave error code on failure.
  */
 _c_public_ int b1_message_dispatch(B1Message *message) {
+        B1Peer *peer;
+        void *context;
+        int r;
+
         assert(message);
 
-        if (message->type == B1_MESSAGE_TYPE_NODE_DESTROY)
-                return b1_message_dispatch_node_destroy(message);
-        else if (message->type == B1_MESSAGE_TYPE_SEED)
-                return b1_message_dispatch_seed(message);
-        else
-                return b1_message_dispatch_data(message);
+        if (_c_likely_(!message->peer->hooked))
+                return b1_message_dispatch_internal(message);
+
+        /* the message might be released by the time the end hook runs */
+        peer = b1_peer_ref(message->peer);
+        context = b1_peer_hook_begin(peer, B1_HOOK_DISPATCH, message);
+        r = b1_message_dispatch_internal(message);
+        b1_peer_hook_end(peer, B1_HOOK_DISPATCH, message, context, r);
+        b1_peer_unref(peer);
+
+        return r;
 }
 
 /**
@@ -903,6 +1797,41 @@ _c_public_ pid_t b1_message_get_tid(B1Message *message) {
         return message->data.tid;
 }
 
+/**
+ * b1_message_get_send_time() - get time a received message was sent at
+ * @message:            the received message
+ *
+ * This is only available if the sending peer enabled send timestamps, see
+ * b1_peer_set_send_timestamps(). The time is taken from CLOCK_MONOTONIC right
+ * before the message is handed to the kernel.
+ *
+ * Return: the send time in nanoseconds, or 0 if not available.
+ */
+_c_public_ uint64_t b1_message_get_send_time(B1Message *message) {
+        if (!message || message->type == B1_MESSAGE_TYPE_NODE_DESTROY)
+                return 0;
+
+        return message->data.send_time;
+}
+
+/**
+ * b1_message_get_queue_delay() - get time a received message spent queued
+ * @message:            the received message
+ *
+ * This is the time between the sender handing the message to the kernel, and
+ * the message being received from the kernel. It is only available if the
+ * sending peer enabled send timestamps, see b1_peer_set_send_timestamps().
+ *
+ * Return: the queueing delay in nanoseconds, or 0 if not available.
+ */
+_c_public_ uint64_t b1_message_get_queue_delay(B1Message *message) {
+        if (!message || message->type == B1_MESSAGE_TYPE_NODE_DESTROY ||
+            !message->data.send_time || message->data.recv_time < message->data.send_time)
+                return 0;
+
+        return message->data.recv_time - message->data.send_time;
+}
+
 /**
  * XXX: see CVariant
  */
@@ -963,6 +1892,20 @@ _c_public_ int b1_message_readv(B1Message *message, const char *signature, va_li
         return c_variant_readv(cv, signature, args);
 }
 
+/**
+ * b1_message_readv_signature() - read payload with a compiled signature
+ * @message:            the message to read from
+ * @signature:          the compiled type to read
+ * @args:               the pointers to read into
+ *
+ * This is b1_message_readv(), but with a compiled signature.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_message_readv_signature(B1Message *message, B1Signature *signature, va_list args) {
+        return b1_message_readv(message, signature->string, args);
+}
+
 /**
  * XXX: see CVariant
  */
@@ -1016,7 +1959,60 @@ _c_public_ int b1_message_writev(B1Message *message, const char *signature, va_l
 }
 
 /**
- * XXX: see CVariant
+ * b1_message_writev_signature() - write payload with a compiled signature
+ * @message:            the message to write to
+ * @signature:          the compiled type to write
+ * @args:               the values to write
+ *
+ * This is b1_message_writev(), but with a compiled signature. A single type of
+ * fixed size is serialized right away, according to its precomputed layout,
+ * and inserted in one go.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_message_writev_signature(B1Message *message, B1Signature *signature, va_list args) {
+        uint64_t buffer[32];
+        struct iovec vec;
+        CVariant *cv = NULL;
+        int r;
+
+        if (message && message->type != B1_MESSAGE_TYPE_NODE_DESTROY)
+                cv = message->data.cv;
+
+        /* c_variant_insert() takes a single complete type */
+        if (!cv || signature->n_types != 1 || !signature->size)
+                return c_variant_writev(cv, signature->string, args);
+
+        if (signature->size > sizeof(buffer)) {
+                vec.iov_base = calloc(1, signature->size);
+                if (!vec.iov_base)
+                        return -ENOMEM;
+        } else {
+                vec.iov_base = memset(buffer, 0, signature->size);
+        }
+        vec.iov_len = signature->size;
+
+        b1_signature_pack(signature, vec.iov_base, args);
+        r = c_variant_insert(cv, signature->string, &vec, 1);
+
+        if (vec.iov_base != buffer)
+                free(vec.iov_base);
+
+        return r;
+}
+
+/**
+ * b1_message_insert() - insert serialized data
+ * @message:            the message to write to
+ * @type:               the type of the data
+ * @vecs:               the serialized data
+ * @n_vecs:             number of vectors in @vecs
+ *
+ * The data is copied into the message, so the caller may reuse @vecs as soon
+ * as this returns. To pass large buffers without copying, see
+ * b1_message_attach().
+ *
+ * Return: 0 on success, or a negative error code on failure.
  */
 _c_public_ int b1_message_insert(B1Message *message, const char *type, const struct iovec *vecs, size_t n_vecs) {
         CVariant *cv = NULL;
@@ -1027,6 +2023,87 @@ _c_public_ int b1_message_insert(B1Message *message, const char *type, const str
         return c_variant_insert(cv, type, vecs, n_vecs);
 }
 
+/**
+ * b1_message_attach() - attach caller memory without copying it
+ * @message:            the message to attach to
+ * @vecs:               the data to attach
+ * @n_vecs:             number of vectors in @vecs
+ * @fn:                 function to call once the data is no longer used, or NULL
+ * @userdata:           userdata to pass to @fn
+ *
+ * Unlike b1_message_insert(), the data is not copied into the message. It is
+ * referenced until the message is destroyed, and passed to the kernel as is
+ * each time the message is sent. As sends may be deferred until the destination
+ * grants credits, @fn is only called when the last reference to @message is
+ * dropped. The caller must not modify the data before that.
+ *
+ * The attachment is not part of the typed payload. It is appended after it,
+ * and the receiver retrieves it via b1_message_get_attachment(). A message
+ * carries at most one attachment, which must be set before it is sealed.
+ *
+ * Return: 0 on success, -EBUSY if the message is already sealed, -EEXIST if it
+ *         already has an attachment, or a negative error code on failure.
+ */
+_c_public_ int b1_message_attach(B1Message *message,
+                                 const struct iovec *vecs,
+                                 size_t n_vecs,
+                                 B1ReleaseFn fn,
+                                 void *userdata) {
+        uint64_t n_bytes = 0;
+        struct iovec *copy;
+
+        if (!message || message->type == B1_MESSAGE_TYPE_NODE_DESTROY ||
+            !vecs || n_vecs < 1)
+                return -EINVAL;
+
+        if (b1_message_is_sealed(message))
+                return -EBUSY;
+
+        if (message->data.attachment.vecs)
+                return -EEXIST;
+
+        for (size_t i = 0; i < n_vecs; ++i)
+                n_bytes += vecs[i].iov_len;
+
+        copy = malloc(n_vecs * sizeof(*vecs));
+        if (!copy)
+                return -ENOMEM;
+
+        message->data.attachment.vecs = memcpy(copy, vecs, n_vecs * sizeof(*vecs));
+        message->data.attachment.n_vecs = n_vecs;
+        message->data.attachment.n_bytes = n_bytes;
+        message->data.attachment.release_fn = fn;
+        message->data.attachment.userdata = userdata;
+
+        return 0;
+}
+
+/**
+ * b1_message_get_attachment() - get the attachment of a received message
+ * @message:            the message
+ * @n_bytesp:           pointer to the returned size of the attachment, or NULL
+ *
+ * The returned data lives in the pool, and is valid as long as @message is. It
+ * is aligned to 8 bytes.
+ *
+ * Return: the attached data, or NULL if the message carries no attachment.
+ */
+_c_public_ const void *b1_message_get_attachment(B1Message *message, size_t *n_bytesp) {
+        const void *data = NULL;
+        size_t n_bytes = 0;
+
+        if (message && message->type != B1_MESSAGE_TYPE_NODE_DESTROY &&
+            message->data.attachment.data) {
+                data = message->data.attachment.data;
+                n_bytes = message->data.attachment.n_bytes;
+        }
+
+        if (n_bytesp)
+                *n_bytesp = n_bytes;
+
+        return data;
+}
+
 /**
  * XXX: see CVariant
  */
@@ -20,6 +20,17 @@
 #include <stdlib.h>
 #include "org.bus1/b1-peer.h"
 
+/* errno values below this have their error replies cached */
+#define B1_MESSAGE_ERRNO_MAX (256)
+
+typedef struct B1MessageErrors B1MessageErrors;
+
+/* set in the type of the envelope, if a send timestamp is appended */
+#define B1_MESSAGE_FLAG_SEND_TIME (UINT64_C(1) << 63)
+/* set in the type of the envelope, if an attachment is appended */
+#define B1_MESSAGE_FLAG_ATTACHMENT (UINT64_C(1) << 62)
+#define B1_MESSAGE_FLAGS (B1_MESSAGE_FLAG_SEND_TIME | B1_MESSAGE_FLAG_ATTACHMENT)
+
 struct B1Message {
         unsigned long n_ref;
         uint64_t type;
@@ -34,6 +45,13 @@ struct B1Message {
                         pid_t tid;
 
                         void *slice;
+                        uint64_t n_slice;
+                        size_t n_envelope;
+                        uint64_t recv_time;
+                        uint64_t send_time;
+                        B1Message *pool_previous;
+                        B1Message *pool_next;
+                        bool pool_linked;
 
                         B1Handle **handles;
                         size_t n_handles;
@@ -42,6 +60,15 @@ struct B1Message {
 
                         CVariant *cv;
 
+                        struct {
+                                struct iovec *vecs;
+                                size_t n_vecs;
+                                uint64_t n_bytes;
+                                B1ReleaseFn release_fn;
+                                void *userdata;
+                                const void *data;
+                        } attachment;
+
                         union {
                                 struct {
                                         const char *interface;
@@ -66,3 +93,6 @@ struct B1Message {
 };
 
 int b1_message_new_from_slice(B1Message **messagep, B1Peer *peer, void *slice, size_t n_bytes);
+int b1_message_parse_header(B1Message *message);
+int b1_message_flush_credits(B1Handle *handle);
+void b1_message_errors_free(B1MessageErrors *errors);
@@ -21,10 +21,12 @@
 #include <errno.h>
 #include "interface.h"
 #include "linux/bus1.h"
+#include "message.h"
 #include "node.h"
 #include "peer.h"
 #include <stdlib.h>
 #include <string.h>
+#include "trace.h"
 
 typedef struct B1Implementation {
         CRBNode rb;
@@ -122,6 +124,8 @@ int b1_handle_new(B1Peer *peer, uint64_t id, B1Handle **handlep) {
         handle->holder = b1_peer_ref(peer);
         handle->id = id;
         handle->marked = false;
+        handle->credits.policy = B1_CREDIT_POLICY_NONE;
+        handle->credits.queue_tail = &handle->credits.queue;
         c_rbnode_init(&handle->rb);
 
         *handlep = handle;
@@ -129,6 +133,18 @@ int b1_handle_new(B1Peer *peer, uint64_t id, B1Handle **handlep) {
         return 0;
 }
 
+static void b1_handle_drop_credits(B1Handle *handle) {
+        B1CreditEntry *entry;
+
+        while ((entry = handle->credits.queue)) {
+                handle->credits.queue = entry->next;
+                b1_message_unref(entry->message);
+                free(entry);
+        }
+
+        handle->credits.queue_tail = &handle->credits.queue;
+}
+
 static void b1_handle_release(B1Handle *handle) {
         if (!handle)
                 return;
@@ -136,6 +152,7 @@ static void b1_handle_release(B1Handle *handle) {
         if (handle->id == BUS1_HANDLE_INVALID)
                 return;
 
+        B1_TRACE(handle_release, handle->id);
         (void)bus1_client_handle_release(handle->holder->client, handle->id);
 }
 
@@ -419,6 +436,7 @@ _c_public_ void b1_node_destroy(B1Node *node) {
         if (!node || node->id == BUS1_HANDLE_INVALID)
                 return;
 
+        B1_TRACE(node_destroy, node->id);
         (void)bus1_client_node_destroy(node->owner->client, node->id);
 }
 
@@ -461,6 +479,7 @@ _c_public_ B1Handle *b1_handle_unref(B1Handle *handle) {
         if (--handle->n_ref > 0)
                 return NULL;
 
+        b1_handle_drop_credits(handle);
         b1_handle_release(handle);
 
         if (handle->id != BUS1_HANDLE_INVALID) {
@@ -487,6 +506,71 @@ _c_public_ B1Peer *b1_handle_get_peer(B1Handle *handle) {
         return handle->holder;
 }
 
+/**
+ * b1_handle_set_credits() - configure flow control on a handle
+ * @handle:             destination handle to operate on
+ * @policy:             what to do when credits are exhausted
+ * @n_bytes:            number of bytes that may be in flight
+ * @n_messages:         number of messages that may be in flight
+ *
+ * Flow control is opt-in and applies to messages that are sent to @handle as
+ * their only destination. Each message that expects a reply consumes its size
+ * in bytes and one message from the credits of @handle. The credits are
+ * returned once the reply (or error) is received and dispatched, or once the
+ * reply slot is freed. The receiver thereby grants new credits simply by
+ * consuming and answering the calls it got.
+ *
+ * The kernel does not tell a sender when the receiver releases a slice, so the
+ * reply is the earliest point credits can be returned without an additional
+ * message. Credits thus bound the calls the receiver has not answered yet,
+ * which bounds its pool usage as long as it releases calls once answered.
+ *
+ * @n_bytes and @n_messages set the currently available credits. They should
+ * match what the receiver is willing to have queued in its pool, and must be
+ * large enough to hold the largest message sent through @handle.
+ *
+ * If a message cannot be sent due to lack of credits, B1_CREDIT_POLICY_REJECT
+ * makes b1_message_send() fail with -EAGAIN, while B1_CREDIT_POLICY_QUEUE
+ * queues the message on @handle and sends it once enough credits were
+ * returned. While messages are queued, all further messages to @handle are
+ * queued behind them, including those that do not expect a reply, so they are
+ * never reordered. If sending a queued message fails later on, its reply slot
+ * is invoked with an org.bus1.Error.Errno error carrying the error code. If a
+ * failure cannot be reported that way, because the message has no reply slot
+ * or the error reply cannot be built, b1_message_dispatch() returns it.
+ * Queued messages are dropped if @handle is freed. Setting the policy to
+ * B1_CREDIT_POLICY_NONE disables flow control and flushes the queue.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+_c_public_ int b1_handle_set_credits(B1Handle *handle, unsigned int policy, uint64_t n_bytes, uint64_t n_messages) {
+        assert(handle);
+
+        if (policy >= _B1_CREDIT_POLICY_N)
+                return -EINVAL;
+
+        handle->credits.policy = policy;
+        handle->credits.n_bytes = n_bytes;
+        handle->credits.n_messages = n_messages;
+
+        return b1_message_flush_credits(handle);
+}
+
+/**
+ * b1_handle_get_credits() - query available credits of a handle
+ * @handle:             handle to query
+ * @n_bytesp:           output argument for available bytes, or NULL
+ * @n_messagesp:        output argument for available messages, or NULL
+ */
+_c_public_ void b1_handle_get_credits(B1Handle *handle, uint64_t *n_bytesp, uint64_t *n_messagesp) {
+        assert(handle);
+
+        if (n_bytesp)
+                *n_bytesp = handle->credits.n_bytes;
+        if (n_messagesp)
+                *n_messagesp = handle->credits.n_messages;
+}
+
 /**
  * b1_subscription_free() - unregister and free subscription
  * @subscription:               a subscription, or NULL
@@ -18,6 +18,14 @@
 #include <c-rbtree.h>
 #include "org.bus1/b1-peer.h"
 
+typedef struct B1CreditEntry B1CreditEntry;
+
+struct B1CreditEntry {
+        B1CreditEntry *next;
+        B1Message *message;
+        uint64_t n_bytes;
+};
+
 struct B1Handle {
         unsigned long n_ref;
 
@@ -29,6 +37,14 @@ struct B1Handle {
 
         B1Subscription *subscriptions;
 
+        struct {
+                unsigned int policy;
+                uint64_t n_bytes;
+                uint64_t n_messages;
+                B1CreditEntry *queue;
+                B1CreditEntry **queue_tail;
+        } credits;
+
         CRBNode rb;
 };
 
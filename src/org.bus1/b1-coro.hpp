@@ -0,0 +1,289 @@
+#pragma once
+
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * C++ Coroutines
+ *
+ * Coroutine support on top of b1-peer.hpp, requiring C++20. An executor runs
+ * tasks on behalf of a single peer. Tasks await calls, which are sent right
+ * away and complete once their reply is dispatched, so a single thread can
+ * keep any number of calls in flight:
+ *
+ *         b1::Task fetch(b1::Executor &executor, B1Handle *handle) {
+ *                 auto reply = co_await executor.call<std::tuple<uint64_t>>(
+ *                         handle, "org.example.Foo", "Bar", uint64_t(7));
+ *                 ...
+ *         }
+ *
+ *         executor.spawn(fetch(executor, handle));
+ *         executor.run();
+ *
+ * Calls are backed by reply slots. Reply callbacks only queue the waiting
+ * task; tasks are always resumed from the executor, never from within
+ * b1_message_dispatch(). Hence, tasks resumed by the same batch of messages
+ * run one after another, and any calls they make are sent before the executor
+ * waits for the peer again.
+ *
+ * The input signature of a call is derived from the types of its arguments,
+ * so arguments must be passed with exactly the types the member expects.
+ */
+
+#include <cerrno>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <poll.h>
+#include <tuple>
+#include <unordered_set>
+#include <utility>
+#include "b1-peer.hpp"
+
+namespace b1 {
+
+class Executor;
+
+template<typename Out>
+struct Reply {
+        /* 0, a negative error code, or -EREMOTEIO if an error was replied */
+        int error = 0;
+        Out value{};
+        Message message;
+};
+
+class Task {
+public:
+        struct promise_type {
+                Task get_return_object() noexcept {
+                        return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+                }
+
+                std::suspend_always initial_suspend() noexcept { return {}; }
+                std::suspend_always final_suspend() noexcept { return {}; }
+                void return_void() noexcept {}
+                void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+
+        ~Task() {
+                if (handle)
+                        handle.destroy();
+        }
+
+private:
+        friend class Executor;
+
+        explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle(handle) {}
+
+        std::coroutine_handle<promise_type> handle;
+};
+
+template<typename In, typename Out>
+class Call;
+
+class Executor {
+public:
+        explicit Executor(B1Peer *peer) noexcept : peer(peer) {}
+        Executor(const Executor &) = delete;
+        Executor &operator=(const Executor &) = delete;
+
+        ~Executor() {
+                for (void *address : tasks)
+                        std::coroutine_handle<>::from_address(address).destroy();
+        }
+
+        int fd() const noexcept { return b1_peer_get_fd(peer); }
+
+        /* take over @task, it is first run by the next call to run() */
+        void spawn(Task task) {
+                auto handle = std::exchange(task.handle, nullptr);
+
+                tasks.insert(handle.address());
+                ready.push_back(handle);
+        }
+
+        void schedule(std::coroutine_handle<> handle) { ready.push_back(handle); }
+
+        /*
+         * Run all ready tasks, then receive and dispatch all queued messages.
+         * This does not block, so it can be used from an external event loop
+         * whenever fd() is readable.
+         */
+        int process() {
+                B1Message *message;
+                int r;
+
+                resume();
+
+                for (;;) {
+                        r = b1_peer_recv(peer, &message);
+                        if (r == -EAGAIN)
+                                break;
+                        else if (r < 0)
+                                return r;
+
+                        r = b1_message_dispatch(message);
+                        b1_message_unref(message);
+                        if (r < 0)
+                                return r;
+                }
+
+                resume();
+
+                return 0;
+        }
+
+        /* process messages until all tasks are done */
+        int run() {
+                struct pollfd pfd = { fd(), POLLIN, 0 };
+                int r;
+
+                r = process();
+                while (r >= 0 && !tasks.empty()) {
+                        r = poll(&pfd, 1, -1);
+                        if (r < 0 && errno == EINTR)
+                                continue;
+                        else if (r < 0)
+                                return -errno;
+
+                        r = process();
+                }
+
+                return r;
+        }
+
+        template<typename Out, typename... Args>
+        Call<std::tuple<std::decay_t<Args>...>, Out> call(B1Handle *handle,
+                                                         const char *interface,
+                                                         const char *member,
+                                                         Args &&...args) {
+                return { *this, handle, interface, member, { std::forward<Args>(args)... } };
+        }
+
+private:
+        template<typename In, typename Out>
+        friend class Call;
+
+        void resume() {
+                while (!ready.empty()) {
+                        auto handle = ready.front();
+
+                        ready.pop_front();
+                        handle.resume();
+
+                        if (tasks.count(handle.address()) && handle.done()) {
+                                tasks.erase(handle.address());
+                                handle.destroy();
+                        }
+                }
+        }
+
+        B1Peer *peer;
+        std::deque<std::coroutine_handle<>> ready;
+        std::unordered_set<void *> tasks;
+};
+
+template<typename In, typename Out>
+class Call {
+public:
+        Call(Executor &executor, B1Handle *handle, const char *interface, const char *member, In input) :
+                executor(executor),
+                handle(handle),
+                interface(interface),
+                member(member),
+                input(std::move(input)) {
+        }
+
+        Call(const Call &) = delete;
+        Call &operator=(const Call &) = delete;
+
+        ~Call() {
+                /* the awaiting task was destroyed, drop the pending reply */
+                b1_reply_slot_free(slot);
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> continuation) {
+                Message message;
+                int r;
+
+                this->continuation = continuation;
+
+                r = Message::new_call<In, Out>(executor.peer, message, interface, member,
+                                               &slot, reply_fn, this);
+                if (r >= 0 && std::tuple_size_v<In> > 0)
+                        r = message.write(input);
+                if (r >= 0)
+                        r = message.send(handle);
+
+                if (r < 0) {
+                        slot = b1_reply_slot_free(slot);
+                        reply.error = r;
+                        return false;
+                }
+
+                return true;
+        }
+
+        Reply<Out> await_resume() {
+                int r;
+
+                slot = b1_reply_slot_free(slot);
+
+                if (reply.error < 0)
+                        return std::move(reply);
+
+                if (reply.message.type() == B1_MESSAGE_TYPE_ERROR) {
+                        reply.error = -EREMOTEIO;
+                        return std::move(reply);
+                }
+
+                if constexpr (std::tuple_size_v<Out> > 0) {
+                        r = reply.message.read(reply.value);
+                        if (r < 0)
+                                reply.error = r;
+                }
+
+                return std::move(reply);
+        }
+
+private:
+        static int reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+                auto call = static_cast<Call *>(userdata);
+
+                call->reply.message = Message(b1_message_ref(message));
+                call->executor.schedule(call->continuation);
+
+                return 0;
+        }
+
+        Executor &executor;
+        B1Handle *handle;
+        const char *interface;
+        const char *member;
+        In input;
+        B1ReplySlot *slot = nullptr;
+        std::coroutine_handle<> continuation;
+        Reply<Out> reply;
+};
+
+} /* namespace b1 */
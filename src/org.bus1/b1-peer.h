@@ -37,14 +37,34 @@ typedef struct B1Node B1Node;
 typedef struct B1Subscription B1Subscription;
 typedef struct B1Peer B1Peer;
 typedef struct B1ReplySlot B1ReplySlot;
+typedef struct B1PoolStats B1PoolStats;
+typedef struct B1IoctlStats B1IoctlStats;
+typedef struct B1Histogram B1Histogram;
+typedef struct B1MemberStats B1MemberStats;
+typedef struct B1Record B1Record;
+typedef struct B1PeerHooks B1PeerHooks;
+typedef struct B1Signature B1Signature;
+typedef struct B1Cursor B1Cursor;
 
 typedef int (*B1NodeFn) (B1Node *node, void *userdata, B1Message *message);
 typedef int (*B1SubscriptionFn) (B1Subscription *subscription, void *userdata, B1Handle *handle);
 typedef int (*B1ReplySlotFn) (B1ReplySlot *slot, void *userdata, B1Message *message);
+typedef void (*B1PeerDropFn) (B1Peer *peer, void *userdata, uint64_t n_dropped);
+typedef void (*B1ReleaseFn) (void *userdata);
 
 /* peers */
 
+#define B1_POOL_SIZE_MIN (256ULL * 1024ULL)
+
+enum {
+        B1_POOL_FLAG_PREFAULT           = 1U << 0,
+        B1_POOL_FLAG_LOCK               = 1U << 1,
+        B1_POOL_FLAG_HUGEPAGE           = 1U << 2,
+        B1_POOL_FLAG_AUTO_SIZE          = 1U << 3,
+};
+
 int b1_peer_new(B1Peer **peerp, const char *path);
+int b1_peer_new_with_pool(B1Peer **peerp, const char *path, size_t pool_size, unsigned int flags);
 int b1_peer_new_from_fd(B1Peer **peerp, int fd);
 B1Peer *b1_peer_ref(B1Peer *peer);
 B1Peer *b1_peer_unref(B1Peer *peer);
@@ -54,9 +74,75 @@ int b1_peer_get_fd(B1Peer *peer);
 int b1_peer_recv(B1Peer *peer, B1Message **messagep);
 int b1_peer_recv_seed(B1Peer *peer, B1Message **seedp);
 int b1_peer_clone(B1Peer *peer, B1Node **nodep, B1Handle **handlep);
+int b1_peer_clone_with_pool(B1Peer *peer, B1Node **nodep, B1Handle **handlep, size_t pool_size, unsigned int flags);
+size_t b1_peer_get_pool_size_hint(B1Peer *peer);
 
 int b1_peer_implement(B1Peer *peer, B1Node **nodep, void *userdata, B1Interface *interface);
 
+struct B1PoolStats {
+        uint64_t pool_size;
+        uint64_t n_slices;
+        uint64_t n_bytes;
+        uint64_t n_slices_max;
+        uint64_t n_bytes_max;
+        uint64_t slice_max;
+        uint64_t oldest_nsec;
+        uint64_t n_dropped;
+        uint64_t n_slices_at_drop;
+        uint64_t n_bytes_at_drop;
+};
+
+void b1_peer_get_pool_stats(B1Peer *peer, B1PoolStats *statsp);
+void b1_peer_set_drop_fn(B1Peer *peer, B1PeerDropFn fn, void *userdata);
+
+#define B1_IOCTL_STATS_BUCKETS (32)
+#define B1_IOCTL_STATS_ERRNO_MAX (160)
+
+enum {
+        B1_IOCTL_PEER_INIT,
+        B1_IOCTL_PEER_QUERY,
+        B1_IOCTL_PEER_RESET,
+        B1_IOCTL_PEER_CLONE,
+        B1_IOCTL_NODE_DESTROY,
+        B1_IOCTL_HANDLE_RELEASE,
+        B1_IOCTL_SLICE_RELEASE,
+        B1_IOCTL_SEND,
+        B1_IOCTL_RECV,
+        _B1_IOCTL_N,
+};
+
+struct B1IoctlStats {
+        struct {
+                uint64_t n_calls;
+                uint64_t n_errors;
+                uint64_t total_nsec;
+                uint64_t latency[B1_IOCTL_STATS_BUCKETS];
+        } cmds[_B1_IOCTL_N];
+        uint64_t errnos[B1_IOCTL_STATS_ERRNO_MAX];
+};
+
+int b1_peer_set_ioctl_stats(B1Peer *peer, bool enable);
+void b1_peer_get_ioctl_stats(B1Peer *peer, B1IoctlStats *statsp);
+
+void b1_peer_set_dispatch_stats(B1Peer *peer, bool enable);
+void b1_peer_set_send_timestamps(B1Peer *peer, bool enable);
+void b1_peer_set_coalesce_threshold(B1Peer *peer, size_t threshold);
+uint64_t b1_peer_get_coalesced_bytes(B1Peer *peer);
+
+enum {
+        B1_HOOK_SEND,
+        B1_HOOK_RECV,
+        B1_HOOK_DISPATCH,
+        _B1_HOOK_N,
+};
+
+struct B1PeerHooks {
+        void *(*begin) (B1Peer *peer, void *userdata, unsigned int event, B1Message *message);
+        void (*end) (B1Peer *peer, void *userdata, unsigned int event, B1Message *message, void *context, int result);
+};
+
+void b1_peer_set_hooks(B1Peer *peer, const B1PeerHooks *hooks, void *userdata);
+
 /* slots */
 
 B1ReplySlot *b1_reply_slot_free(B1ReplySlot *slot);
@@ -99,6 +185,26 @@ int b1_message_new_error(B1Peer *peer,
                          B1Message **messagep,
                          const char *name,
                          const char *signature);
+int b1_message_new_call_signature(B1Peer *peer,
+                                  B1Message **messagep,
+                                  const char *interface,
+                                  const char *member,
+                                  B1Signature *signature_input,
+                                  B1Signature *signature_output,
+                                  B1ReplySlot **slotp,
+                                  B1ReplySlotFn fn,
+                                  void *userdata);
+int b1_message_new_reply_signature(B1Peer *peer,
+                                   B1Message **messagep,
+                                   B1Signature *signature_input,
+                                   B1Signature *signature_output,
+                                   B1ReplySlot **slotp,
+                                   B1ReplySlotFn fn,
+                                   void *userdata);
+int b1_message_new_error_signature(B1Peer *peer,
+                                   B1Message **messagep,
+                                   const char *name,
+                                   B1Signature *signature);
 int b1_message_new_seed(B1Peer *peer,
                         B1Message **messagep,
                         B1Node **nodes,
@@ -119,18 +225,28 @@ uid_t b1_message_get_uid(B1Message *message);
 gid_t b1_message_get_gid(B1Message *message);
 pid_t b1_message_get_pid(B1Message *message);
 pid_t b1_message_get_tid(B1Message *message);
+uint64_t b1_message_get_send_time(B1Message *message);
+uint64_t b1_message_get_queue_delay(B1Message *message);
 
 size_t b1_message_peek_count(B1Message *message);
 const char *b1_message_peek_type(B1Message *message, size_t *sizep);
 int b1_message_enter(B1Message *message, const char *containers);
 int b1_message_exit(B1Message *message, const char *containers);
 int b1_message_readv(B1Message *message, const char *signature, va_list args);
+int b1_message_readv_signature(B1Message *message, B1Signature *signature, va_list args);
 void b1_message_rewind(B1Message *message);
 
 int b1_message_beginv(B1Message *message, const char *containers, va_list args);
 int b1_message_end(B1Message *message, const char *containers);
 int b1_message_writev(B1Message *message, const char *signature, va_list args);
+int b1_message_writev_signature(B1Message *message, B1Signature *signature, va_list args);
 int b1_message_insert(B1Message *message, const char *type, const struct iovec *vecs, size_t n_vecs);
+int b1_message_attach(B1Message *message,
+                      const struct iovec *vecs,
+                      size_t n_vecs,
+                      B1ReleaseFn fn,
+                      void *userdata);
+const void *b1_message_get_attachment(B1Message *message, size_t *n_bytesp);
 int b1_message_seal(B1Message *message);
 
 int b1_message_append_handle(B1Message *message, B1Handle *handle);
@@ -138,6 +254,30 @@ int b1_message_append_fd(B1Message *message, int fd);
 int b1_message_get_handle(B1Message *message, unsigned int index, B1Handle **handlep);
 int b1_message_get_fd(B1Message *message, unsigned int index, int *fdp);
 
+/* cursors */
+
+struct B1Cursor {
+        /* private */
+        B1Signature *signature;
+        const uint8_t *data;
+        size_t n_data;
+        size_t offsets;
+        size_t offset_size;
+        size_t type;
+        size_t index;
+        size_t n_values;
+        size_t position;
+        size_t frame;
+        char container;
+};
+
+int b1_message_open_cursor(B1Message *message, B1Signature *signature, B1Cursor *cursor);
+int b1_cursor_enter(B1Cursor *cursor, B1Cursor *child);
+const void *b1_cursor_next(B1Cursor *cursor, size_t *n_bytesp);
+int b1_cursor_skip(B1Cursor *cursor, size_t n_values);
+size_t b1_cursor_get_count(B1Cursor *cursor);
+const char *b1_cursor_peek_type(B1Cursor *cursor, size_t *n_typep);
+
 /* nodes */
 
 int b1_node_new(B1Peer *peer, B1Node **nodep, void *userdata);
@@ -162,6 +302,16 @@ B1Peer *b1_handle_get_peer(B1Handle *handle);
 
 int b1_handle_subscribe(B1Handle *handle, B1Subscription **subscriptionp, B1SubscriptionFn fn, void *userdata);
 
+enum {
+        B1_CREDIT_POLICY_NONE,
+        B1_CREDIT_POLICY_REJECT,
+        B1_CREDIT_POLICY_QUEUE,
+        _B1_CREDIT_POLICY_N,
+};
+
+int b1_handle_set_credits(B1Handle *handle, unsigned int policy, uint64_t n_bytes, uint64_t n_messages);
+void b1_handle_get_credits(B1Handle *handle, uint64_t *n_bytesp, uint64_t *n_messagesp);
+
 /* interfaces */
 
 int b1_interface_new(B1Interface **interfacep, const char *name);
@@ -174,6 +324,67 @@ int b1_interface_add_member(B1Interface *interface,
                             const char *type_output,
                             B1NodeFn fn);
 
+/* signatures */
+
+int b1_signature_new(B1Signature **signaturep, const char *string);
+B1Signature *b1_signature_ref(B1Signature *signature);
+B1Signature *b1_signature_unref(B1Signature *signature);
+
+const char *b1_signature_get_string(B1Signature *signature, size_t *n_stringp);
+size_t b1_signature_get_alignment(B1Signature *signature);
+size_t b1_signature_get_size(B1Signature *signature);
+
+/* histograms */
+
+#define B1_HISTOGRAM_SUB_BITS (3)
+#define B1_HISTOGRAM_BUCKETS ((64 - B1_HISTOGRAM_SUB_BITS + 1) << B1_HISTOGRAM_SUB_BITS)
+
+struct B1Histogram {
+        uint64_t n_samples;
+        uint64_t sum_nsec;
+        uint64_t max_nsec;
+        uint64_t buckets[B1_HISTOGRAM_BUCKETS];
+};
+
+struct B1MemberStats {
+        B1Histogram handler;
+        B1Histogram queue;
+};
+
+uint64_t b1_histogram_bucket_to_nsec(unsigned int bucket);
+uint64_t b1_histogram_get_percentile(const B1Histogram *histogram, double percentile);
+
+int b1_interface_get_stats(B1Interface *interface, const char *member, B1MemberStats *statsp);
+void b1_interface_reset_stats(B1Interface *interface);
+
+/* flight recorder */
+
+#define B1_RECORD_NAME_MAX (32)
+
+enum {
+        B1_RECORD_SEND,
+        B1_RECORD_RECV,
+        B1_RECORD_DISPATCH,
+};
+
+struct B1Record {
+        uint64_t timestamp;
+        uint64_t destination;
+        uint64_t n_bytes;
+        uint64_t duration_nsec;
+        int32_t result;
+        uint8_t kind;
+        uint8_t type;
+        uint16_t n_handles;
+        uint16_t n_fds;
+        char interface[B1_RECORD_NAME_MAX];
+        char member[B1_RECORD_NAME_MAX];
+};
+
+int b1_peer_set_recorder(B1Peer *peer, size_t n_records);
+size_t b1_peer_get_records(B1Peer *peer, B1Record *records, size_t n_records);
+int b1_peer_dump_records(B1Peer *peer, int fd);
+
 /* convenience */
 
 int b1_peer_export_to_environment(B1Peer *peer);
@@ -217,6 +428,11 @@ static inline void b1_interface_unrefp(B1Interface **interface) {
                 b1_interface_unref(*interface);
 }
 
+static inline void b1_signature_unrefp(B1Signature **signature) {
+        if (*signature)
+                b1_signature_unref(*signature);
+}
+
 static inline int b1_message_read(B1Message *message,
                                   const char *signature, ...) {
         va_list args;
@@ -250,6 +466,28 @@ static inline int b1_message_write(B1Message *message,
         return r;
 }
 
+static inline int b1_message_read_signature(B1Message *message,
+                                            B1Signature *signature, ...) {
+        va_list args;
+        int r;
+
+        va_start(args, signature);
+        r = b1_message_readv_signature(message, signature, args);
+        va_end(args);
+        return r;
+}
+
+static inline int b1_message_write_signature(B1Message *message,
+                                             B1Signature *signature, ...) {
+        va_list args;
+        int r;
+
+        va_start(args, signature);
+        r = b1_message_writev_signature(message, signature, args);
+        va_end(args);
+        return r;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,457 @@
+#pragma once
+
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * C++ Bindings
+ *
+ * Header-only wrappers around b1-peer.h, requiring C++17. Every wrapper owns a
+ * single reference to the underlying object and releases it when destroyed.
+ * Wrappers can be moved but not copied, so no reference is taken or dropped
+ * implicitly; ref() takes an additional reference explicitly.
+ *
+ * Signatures are derived from C++ types at compile time, see b1::signature_v.
+ * Values are written with b1_message_insert() directly from their memory
+ * rather than being formatted via varargs. Errors are reported as negative
+ * error codes, just like the C API.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "b1-peer.h"
+
+namespace b1 {
+
+/* signatures */
+
+template<std::size_t N>
+struct Signature {
+        char string[N + 1] = {};
+
+        constexpr const char *c_str() const noexcept { return string; }
+        static constexpr std::size_t size() noexcept { return N; }
+};
+
+template<std::size_t A, std::size_t B>
+constexpr Signature<A + B> operator+(const Signature<A> &a, const Signature<B> &b) noexcept {
+        Signature<A + B> s{};
+
+        for (std::size_t i = 0; i < A; ++i)
+                s.string[i] = a.string[i];
+        for (std::size_t i = 0; i < B; ++i)
+                s.string[A + i] = b.string[i];
+
+        return s;
+}
+
+namespace detail {
+
+constexpr Signature<1> signature_char(char c) noexcept {
+        Signature<1> s{};
+
+        s.string[0] = c;
+        return s;
+}
+
+template<typename T, typename = void>
+struct Type;
+
+template<typename T, char C>
+struct Basic {
+        static constexpr Signature<1> signature = signature_char(C);
+        static constexpr bool fixed = true;
+
+        static int write(B1Message *message, const T &value) noexcept {
+                struct iovec vec = { const_cast<T *>(&value), sizeof(value) };
+
+                return b1_message_insert(message, signature.c_str(), &vec, 1);
+        }
+
+        static int read(B1Message *message, T &value) noexcept {
+                return b1_message_read(message, signature.c_str(), &value);
+        }
+};
+
+template<> struct Type<uint8_t> : Basic<uint8_t, 'y'> {};
+template<> struct Type<int16_t> : Basic<int16_t, 'n'> {};
+template<> struct Type<uint16_t> : Basic<uint16_t, 'q'> {};
+template<> struct Type<int32_t> : Basic<int32_t, 'i'> {};
+template<> struct Type<uint32_t> : Basic<uint32_t, 'u'> {};
+template<> struct Type<int64_t> : Basic<int64_t, 'x'> {};
+template<> struct Type<uint64_t> : Basic<uint64_t, 't'> {};
+template<> struct Type<double> : Basic<double, 'd'> {};
+
+template<>
+struct Type<bool> {
+        static constexpr Signature<1> signature = signature_char('b');
+        static constexpr bool fixed = false;
+
+        /* serialized booleans are a single byte */
+        static int write(B1Message *message, bool value) noexcept {
+                uint8_t byte = value;
+                struct iovec vec = { &byte, sizeof(byte) };
+
+                return b1_message_insert(message, signature.c_str(), &vec, 1);
+        }
+
+        static int read(B1Message *message, bool &value) noexcept {
+                return b1_message_read(message, signature.c_str(), &value);
+        }
+};
+
+struct String {
+        static constexpr Signature<1> signature = signature_char('s');
+        static constexpr bool fixed = false;
+
+        static int write(B1Message *message, std::string_view value) noexcept {
+                static const char zero = 0;
+                struct iovec vecs[] = {
+                        { const_cast<char *>(value.data()), value.size() },
+                        { const_cast<char *>(&zero), 1 },
+                };
+
+                return b1_message_insert(message, signature.c_str(), vecs, 2);
+        }
+
+        static int read(B1Message *message, const char *&value) noexcept {
+                return b1_message_read(message, signature.c_str(), &value);
+        }
+};
+
+template<>
+struct Type<const char *> : String {
+        static int write(B1Message *message, const char *value) noexcept {
+                return String::write(message, value);
+        }
+
+        using String::read;
+};
+
+template<>
+struct Type<std::string_view> : String {
+        using String::write;
+
+        static int read(B1Message *message, std::string_view &value) noexcept {
+                const char *string = nullptr;
+                int r;
+
+                r = String::read(message, string);
+                if (r >= 0)
+                        value = string;
+                return r;
+        }
+};
+
+template<>
+struct Type<std::string> : String {
+        using String::write;
+
+        static int read(B1Message *message, std::string &value) {
+                const char *string = nullptr;
+                int r;
+
+                r = String::read(message, string);
+                if (r >= 0)
+                        value = string;
+                return r;
+        }
+};
+
+template<typename... Ts>
+struct Type<std::tuple<Ts...>> {
+        static constexpr auto signature = (signature_char('(') + ... + Type<Ts>::signature) + signature_char(')');
+        static constexpr bool fixed = false;
+
+        static int write(B1Message *message, const std::tuple<Ts...> &value) noexcept {
+                int r;
+
+                r = b1_message_begin(message, "(");
+                if (r < 0)
+                        return r;
+
+                r = std::apply([message](const Ts &...values) {
+                        int k = 0;
+
+                        ((k = k < 0 ? k : Type<Ts>::write(message, values)), ...);
+                        return k;
+                }, value);
+                if (r < 0)
+                        return r;
+
+                return b1_message_end(message, ")");
+        }
+
+        static int read(B1Message *message, std::tuple<Ts...> &value) {
+                int r;
+
+                r = b1_message_enter(message, "(");
+                if (r < 0)
+                        return r;
+
+                r = std::apply([message](Ts &...values) {
+                        int k = 0;
+
+                        ((k = k < 0 ? k : Type<Ts>::read(message, values)), ...);
+                        return k;
+                }, value);
+                if (r < 0)
+                        return r;
+
+                return b1_message_exit(message, ")");
+        }
+};
+
+template<typename T>
+struct Type<std::vector<T>> {
+        static constexpr auto signature = signature_char('a') + Type<T>::signature;
+        static constexpr bool fixed = false;
+
+        static int write(B1Message *message, const std::vector<T> &value) noexcept {
+                int r;
+
+                /* arrays of fixed-size elements are serialized back to back */
+                if constexpr (Type<T>::fixed) {
+                        struct iovec vec = { const_cast<T *>(value.data()), value.size() * sizeof(T) };
+
+                        return b1_message_insert(message, signature.c_str(), &vec, 1);
+                } else {
+                        r = b1_message_begin(message, "a");
+                        if (r < 0)
+                                return r;
+
+                        for (const auto &element : value) {
+                                r = Type<T>::write(message, element);
+                                if (r < 0)
+                                        return r;
+                        }
+
+                        return b1_message_end(message, "a");
+                }
+        }
+
+        static int read(B1Message *message, std::vector<T> &value) {
+                int r;
+
+                r = b1_message_enter(message, "a");
+                if (r < 0)
+                        return r;
+
+                value.clear();
+                value.reserve(b1_message_peek_count(message));
+
+                while (b1_message_peek_count(message) > 0) {
+                        r = Type<T>::read(message, value.emplace_back());
+                        if (r < 0)
+                                return r;
+                }
+
+                return b1_message_exit(message, "a");
+        }
+};
+
+/* the empty structure is left out of messages, see b1_message_new_reply() */
+template<typename T>
+constexpr const char *message_signature() noexcept {
+        if constexpr (std::is_same_v<T, std::tuple<>>)
+                return "";
+        else
+                return Type<T>::signature.c_str();
+}
+
+} /* namespace detail */
+
+template<typename T>
+inline constexpr auto signature_v = detail::Type<std::decay_t<T>>::signature;
+
+/* objects */
+
+template<typename T, T *(*Release)(T *)>
+class Object {
+public:
+        Object() noexcept = default;
+        explicit Object(T *object) noexcept : object(object) {}
+        Object(Object &&other) noexcept : object(std::exchange(other.object, nullptr)) {}
+        Object(const Object &) = delete;
+        ~Object() { reset(); }
+
+        Object &operator=(Object &&other) noexcept {
+                if (this != &other)
+                        reset(std::exchange(other.object, nullptr));
+                return *this;
+        }
+
+        Object &operator=(const Object &) = delete;
+
+        T *get() const noexcept { return object; }
+        explicit operator bool() const noexcept { return object; }
+
+        T *release() noexcept { return std::exchange(object, nullptr); }
+
+        void reset(T *other = nullptr) noexcept {
+                if (object)
+                        Release(object);
+                object = other;
+        }
+
+        /* release the current object, and return storage for a new one */
+        T **out() noexcept {
+                reset();
+                return &object;
+        }
+
+protected:
+        T *object = nullptr;
+};
+
+class Interface : public Object<B1Interface, b1_interface_unref> {
+public:
+        using Object::Object;
+
+        static int create(Interface &interface, const char *name) noexcept {
+                return b1_interface_new(interface.out(), name);
+        }
+
+        Interface ref() const noexcept { return Interface(b1_interface_ref(object)); }
+
+        template<typename In, typename Out>
+        int add_member(const char *name, B1NodeFn fn) noexcept {
+                return b1_interface_add_member(object, name,
+                                               signature_v<In>.c_str(),
+                                               signature_v<Out>.c_str(),
+                                               fn);
+        }
+};
+
+class Handle : public Object<B1Handle, b1_handle_unref> {
+public:
+        using Object::Object;
+
+        /* take a reference to a handle owned elsewhere */
+        static Handle ref(B1Handle *handle) noexcept { return Handle(b1_handle_ref(handle)); }
+        Handle ref() const noexcept { return ref(object); }
+
+        B1Peer *peer() const noexcept { return b1_handle_get_peer(object); }
+};
+
+class Node : public Object<B1Node, b1_node_free> {
+public:
+        using Object::Object;
+
+        static int create(B1Peer *peer, Node &node, void *userdata = nullptr) noexcept {
+                return b1_node_new(peer, node.out(), userdata);
+        }
+
+        B1Peer *peer() const noexcept { return b1_node_get_peer(object); }
+        B1Handle *handle() const noexcept { return b1_node_get_handle(object); }
+        void *userdata() const noexcept { return b1_node_get_userdata(object); }
+
+        int implement(const Interface &interface) noexcept {
+                return b1_node_implement(object, interface.get());
+        }
+};
+
+class Message : public Object<B1Message, b1_message_unref> {
+public:
+        using Object::Object;
+
+        template<typename In, typename Out>
+        static int new_call(B1Peer *peer,
+                            Message &message,
+                            const char *interface,
+                            const char *member,
+                            B1ReplySlot **slotp = nullptr,
+                            B1ReplySlotFn fn = nullptr,
+                            void *userdata = nullptr) noexcept {
+                return b1_message_new_call(peer, message.out(), interface, member,
+                                           detail::message_signature<In>(),
+                                           signature_v<Out>.c_str(),
+                                           slotp, fn, userdata);
+        }
+
+        template<typename In>
+        static int new_reply(B1Peer *peer, Message &message) noexcept {
+                return b1_message_new_reply(peer, message.out(),
+                                            detail::message_signature<In>(), "",
+                                            nullptr, nullptr, nullptr);
+        }
+
+        static int new_error(B1Peer *peer, Message &message, const char *name) noexcept {
+                return b1_message_new_error(peer, message.out(), name, "");
+        }
+
+        Message ref() const noexcept { return Message(b1_message_ref(object)); }
+
+        unsigned int type() const noexcept { return b1_message_get_type(object); }
+        B1Handle *reply_handle() const noexcept { return b1_message_get_reply_handle(object); }
+
+        /* write each value in order, a std::tuple is written as structure */
+        template<typename... Ts>
+        int write(const Ts &...values) noexcept {
+                int r = 0;
+
+                ((r = r < 0 ? r : detail::Type<std::decay_t<Ts>>::write(object, values)), ...);
+                return r;
+        }
+
+        template<typename... Ts>
+        int read(Ts &...values) {
+                int r = 0;
+
+                ((r = r < 0 ? r : detail::Type<Ts>::read(object, values)), ...);
+                return r;
+        }
+
+        int seal() noexcept { return b1_message_seal(object); }
+        void rewind() noexcept { b1_message_rewind(object); }
+        int dispatch() noexcept { return b1_message_dispatch(object); }
+
+        int send(B1Handle *handle) noexcept { return b1_message_send(object, &handle, 1); }
+        int send(const Handle &handle) noexcept { return send(handle.get()); }
+        int reply(const Message &reply) noexcept { return b1_message_reply(object, reply.get()); }
+};
+
+class Peer : public Object<B1Peer, b1_peer_unref> {
+public:
+        using Object::Object;
+
+        static int create(Peer &peer, const char *path = nullptr) noexcept {
+                return b1_peer_new(peer.out(), path);
+        }
+
+        Peer ref() const noexcept { return Peer(b1_peer_ref(object)); }
+
+        int fd() const noexcept { return b1_peer_get_fd(object); }
+
+        int clone(Node &node, Handle &handle) noexcept {
+                return b1_peer_clone(object, node.out(), handle.out());
+        }
+
+        int recv(Message &message) noexcept {
+                return b1_peer_recv(object, message.out());
+        }
+};
+
+} /* namespace b1 */
@@ -24,19 +24,41 @@
 #include "message.h"
 #include "node.h"
 #include "peer.h"
+#include "recorder.h"
 #include <stdlib.h>
 #include <string.h>
+#include "trace.h"
+
+static unsigned int b1_peer_mmap_flags(unsigned int flags) {
+        unsigned int mmap_flags = 0;
+
+        if (flags & B1_POOL_FLAG_PREFAULT)
+                mmap_flags |= BUS1_CLIENT_MMAP_POPULATE;
+        if (flags & B1_POOL_FLAG_LOCK)
+                mmap_flags |= BUS1_CLIENT_MMAP_LOCK;
+        if (flags & B1_POOL_FLAG_HUGEPAGE)
+                mmap_flags |= BUS1_CLIENT_MMAP_HUGEPAGE;
+
+        return mmap_flags;
+}
 
 /**
- * b1_peer_new() - creates a new disconnected peer
+ * b1_peer_new_with_pool() - creates a new disconnected peer with custom pool
  * @peerp:              the new peer object
  * @path:               the path to the bus1 character device, or NULL
+ * @pool_size:          size of the receive pool, or 0 for the default
+ * @flags:              B1_POOL_FLAG_* flags controlling the pool mapping
  *
- * Create a new peer disconnected from all existing peers.
+ * Create a new peer disconnected from all existing peers, like b1_peer_new(),
+ * but with a pool of @pool_size bytes. B1_POOL_FLAG_PREFAULT faults in the
+ * whole pool upfront, B1_POOL_FLAG_LOCK locks it into memory, and
+ * B1_POOL_FLAG_HUGEPAGE advises the kernel to back it by transparent
+ * hugepages. B1_POOL_FLAG_AUTO_SIZE has no effect here, as there is no usage
+ * to base the size on.
  *
  * Return: 0 on success, a negative error code on failure.
  */
-_c_public_ int b1_peer_new(B1Peer **peerp, const char *path) {
+_c_public_ int b1_peer_new_with_pool(B1Peer **peerp, const char *path, size_t pool_size, unsigned int flags) {
         _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
         int r;
 
@@ -52,11 +74,11 @@ _c_public_ int b1_peer_new(B1Peer **peerp, const char *path) {
         if (r < 0)
                 return r;
 
-        r = bus1_client_init(peer->client, BUS1_CLIENT_POOL_SIZE);
+        r = bus1_client_init(peer->client, pool_size ?: BUS1_CLIENT_POOL_SIZE);
         if (r < 0)
                 return r;
 
-        r = bus1_client_mmap(peer->client);
+        r = bus1_client_mmap(peer->client, b1_peer_mmap_flags(flags));
         if (r < 0)
                 return r;
 
@@ -67,16 +89,19 @@ _c_public_ int b1_peer_new(B1Peer **peerp, const char *path) {
 }
 
 /**
- * b1_peer_new_from_fd() - create new peer object from existing fd
+ * b1_peer_new() - creates a new disconnected peer
  * @peerp:              the new peer object
- * @fd:                 a file descriptor representing an existing peer
+ * @path:               the path to the bus1 character device, or NULL
  *
- * This takes a pre-initialized bus1 filedescriptor and wrapps creates a b1_peer
- * object around it.
+ * Create a new peer disconnected from all existing peers.
  *
  * Return: 0 on success, a negative error code on failure.
  */
-_c_public_ int b1_peer_new_from_fd(B1Peer **peerp, int fd) {
+_c_public_ int b1_peer_new(B1Peer **peerp, const char *path) {
+        return b1_peer_new_with_pool(peerp, path, 0, 0);
+}
+
+static int b1_peer_new_from_fd_internal(B1Peer **peerp, int fd, unsigned int flags) {
         _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
         int r;
 
@@ -92,7 +117,7 @@ _c_public_ int b1_peer_new_from_fd(B1Peer **peerp, int fd) {
         if (r < 0)
                 return r;
 
-        r = bus1_client_mmap(peer->client);
+        r = bus1_client_mmap(peer->client, b1_peer_mmap_flags(flags));
         if (r < 0)
                 return r;
 
@@ -102,6 +127,20 @@ _c_public_ int b1_peer_new_from_fd(B1Peer **peerp, int fd) {
         return 0;
 }
 
+/**
+ * b1_peer_new_from_fd() - create new peer object from existing fd
+ * @peerp:              the new peer object
+ * @fd:                 a file descriptor representing an existing peer
+ *
+ * This takes a pre-initialized bus1 filedescriptor and wrapps creates a b1_peer
+ * object around it.
+ *
+ * Return: 0 on success, a negative error code on failure.
+ */
+_c_public_ int b1_peer_new_from_fd(B1Peer **peerp, int fd) {
+        return b1_peer_new_from_fd_internal(peerp, fd, 0);
+}
+
 /**
  * b1_peer_ref() - acquire reference
  * @peer:               peer to acquire reference to, or NULL
@@ -126,6 +165,7 @@ _c_public_ B1Peer *b1_peer_ref(B1Peer *peer) {
  * Return: NULL is returned.
  */
 _c_public_ B1Peer *b1_peer_unref(B1Peer *peer) {
+        B1MessageErrors *errors;
         CRBNode *n;
 
         if (!peer)
@@ -133,8 +173,20 @@ _c_public_ B1Peer *b1_peer_unref(B1Peer *peer) {
 
         assert(peer->n_ref > 0);
 
-        if (--peer->n_ref > 0)
+        if (--peer->n_ref > peer->n_cached)
+                return NULL;
+
+        if (peer->n_ref > 0) {
+                /*
+                 * Only the cached error replies are left, break the cycle.
+                 * The last message to be released releases @peer.
+                 */
+                errors = peer->errors;
+                peer->errors = NULL;
+                peer->n_cached = 0;
+                b1_message_errors_free(errors);
                 return NULL;
+        }
 
         while ((n = c_rbtree_first(&peer->root_nodes))) {
                 B1Node *node = c_container_of(n, B1Node, rb);
@@ -145,6 +197,10 @@ _c_public_ B1Peer *b1_peer_unref(B1Peer *peer) {
 
         assert(!c_rbtree_first(&peer->handles));
         assert(!c_rbtree_first(&peer->nodes));
+        b1_recorder_free(peer->recorder);
+        b1_message_errors_free(peer->errors);
+        free(peer->coalesce.buffer);
+        free(peer->coalesce.vecs);
         bus1_client_free(peer->client);
         free(peer);
 
@@ -167,7 +223,6 @@ static int b1_peer_recv_data(B1Peer *peer, struct bus1_msg_data *data, B1Message
         _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
         const uint64_t *handle_ids;
         void *slice;
-        unsigned int reply_handle;
         int r;
 
         assert(peer);
@@ -180,6 +235,11 @@ static int b1_peer_recv_data(B1Peer *peer, struct bus1_msg_data *data, B1Message
         if (r < 0)
                 return r;
 
+        b1_peer_pool_link(peer, message,
+                          c_align_to(data->n_bytes, 8) +
+                          data->n_handles * sizeof(uint64_t) +
+                          data->n_fds * sizeof(int));
+
         message->data.destination = data->destination;
         message->data.uid = data->uid;
         message->data.gid = data->gid;
@@ -201,127 +261,15 @@ static int b1_peer_recv_data(B1Peer *peer, struct bus1_msg_data *data, B1Message
                         return r;
         }
 
-        r = c_variant_enter(message->data.cv, "(");
+        r = b1_message_parse_header(message);
         if (r < 0)
                 return r;
 
-        r = c_variant_read(message->data.cv, "t", &message->type);
-        if (r < 0)
-                return r;
-
-        switch (message->type) {
-        case B1_MESSAGE_TYPE_CALL:
-                r = c_variant_enter(message->data.cv, "v(");
-                if (r < 0)
-                        return r;
-
-                r = c_variant_read(message->data.cv, "ss",
-                                   &message->data.call.interface,
-                                   &message->data.call.member);
-                if (r < 0)
-                        return r;
-
-                r = c_variant_enter(message->data.cv, "m");
-                if (r < 0)
-                        return r;
-
-                r = c_variant_peek_count(message->data.cv);
-                if (r < 0)
-                        return r;
-                else if (r == 1) {
-                        r = c_variant_read(message->data.cv, "u", &reply_handle);
-                        if (r < 0)
-                                return r;
-
-                        if (data->n_handles <= reply_handle)
-                                return -EIO;
-
-                        message->data.call.reply_handle = message->data.handles[reply_handle];
-                } else
-                        message->data.call.reply_handle = NULL;
+        B1_TRACE(recv, message, message->type, data->n_bytes, data->n_handles, data->n_fds, data->destination);
 
-                r = c_variant_exit(message->data.cv, "m)v");
-
-                break;
-
-        case B1_MESSAGE_TYPE_REPLY:
-                r = c_variant_enter(message->data.cv, "vm");
-                if (r < 0)
-                        return r;
-
-                r = c_variant_peek_count(message->data.cv);
-                if (r < 0)
-                        return r;
-                else if (r == 1) {
-                        r = c_variant_read(message->data.cv, "u", &reply_handle);
-                        if (r < 0)
-                                return r;
-
-                        if (data->n_handles <= reply_handle)
-                                return -EIO;
-
-                        message->data.reply.reply_handle = message->data.handles[reply_handle];
-                } else
-                        message->data.reply.reply_handle = NULL;
-
-                r = c_variant_exit(message->data.cv, "mv");
-
-                break;
-
-        case B1_MESSAGE_TYPE_ERROR:
-                r = c_variant_read(message->data.cv, "v", "s", &message->data.error.name);
-                if (r < 0)
-                        return r;
-
-                break;
-
-        case B1_MESSAGE_TYPE_SEED:
-                r = c_variant_enter(message->data.cv, "va");
-                if (r < 0)
-                        return r;
-
-                r = c_variant_peek_count(message->data.cv);
-                if (r < 0)
-                        return r;
-
-                message->data.seed.root_nodes = (CRBTree){};
-
-                for (unsigned i = 0, n = r; i < n; i ++) {
-                        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
-                        const char *name;
-                        unsigned int offset;
-                        CRBNode **slot, *p;
-
-                        r = c_variant_read(message->data.cv, "(su)", &name, &offset);
-                        if (r < 0)
-                                return r;
-
-                        slot = c_rbtree_find_slot(&message->data.seed.root_nodes,
-                                                  root_nodes_compare, name, &p);
-                        if (!slot)
-                                return -EIO;
-
-                        r = b1_node_new_internal(peer, &node, NULL,
-                                                 message->data.handles[offset]->id, name);
-                        if (r < 0)
-                                return r;
-
-                        node->handle = b1_handle_ref(message->data.handles[offset]);
-
-                        c_rbtree_add(&message->data.seed.root_nodes, p, slot, &node->rb);
-
-                        node = NULL;
-                }
-
-                break;
-
-        default:
-                return -EIO;
-        }
-
-        r = c_variant_enter(message->data.cv, "v");
-        if (r < 0)
-                return r;
+        if (_c_unlikely_(peer->recorder))
+                b1_recorder_record(peer->recorder, B1_RECORD_RECV, message,
+                                   data->destination, data->n_bytes, 0, 0);
 
         *messagep = message;
         message = NULL;
@@ -341,6 +289,7 @@ static int b1_peer_recv_node_destroy(B1Peer *peer,
         message->type = B1_MESSAGE_TYPE_NODE_DESTROY;
         message->n_ref = 1;
         message->node_destroy.handle_id = node_destroy->handle;
+        B1_TRACE(recv_node_destroy, node_destroy->handle);
         message->peer = b1_peer_ref(peer);
 
         *messagep = message;
@@ -349,25 +298,28 @@ static int b1_peer_recv_node_destroy(B1Peer *peer,
         return 0;
 }
 
-/**
- * b1_peer_recv() - receive one message
- * @peer:               the receiving peer
- * @messagep:           the received message
- *
- * Dequeues one message from the queue if available and returns it.
- *
- * Return: 0 on success, or a negative error code on failure.
- */
-_c_public_ int b1_peer_recv(B1Peer *peer, B1Message **messagep) {
+static void b1_peer_account_dropped(B1Peer *peer, uint64_t n_dropped) {
+        if (_c_likely_(!n_dropped))
+                return;
+
+        peer->pool.n_dropped += n_dropped;
+        peer->pool.n_slices_at_drop = peer->pool.n_slices;
+        peer->pool.n_bytes_at_drop = peer->pool.n_bytes;
+
+        if (peer->drop_fn)
+                peer->drop_fn(peer, peer->drop_userdata, n_dropped);
+}
+
+static int b1_peer_recv_internal(B1Peer *peer, B1Message **messagep) {
         struct bus1_cmd_recv recv = {};
         int r;
 
-        assert(peer);
-
         r = bus1_client_recv(peer->client, &recv);
         if (r < 0)
                 return r;
 
+        b1_peer_account_dropped(peer, recv.n_dropped);
+
         switch (recv.type) {
                 case BUS1_MSG_DATA:
                         return b1_peer_recv_data(peer, &recv.data, messagep);
@@ -380,6 +332,35 @@ _c_public_ int b1_peer_recv(B1Peer *peer, B1Message **messagep) {
         return -EIO;
 }
 
+/**
+ * b1_peer_recv() - receive one message
+ * @peer:               the receiving peer
+ * @messagep:           the received message
+ *
+ * Dequeues one message from the queue if available and returns it.
+ *
+ * If the kernel reports that messages were dropped for this peer, the drop
+ * count is accounted in the pool statistics, and the drop callback is invoked
+ * before the message is returned. See b1_peer_set_drop_fn().
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_peer_recv(B1Peer *peer, B1Message **messagep) {
+        void *context;
+        int r;
+
+        assert(peer);
+
+        if (_c_likely_(!peer->hooked))
+                return b1_peer_recv_internal(peer, messagep);
+
+        context = b1_peer_hook_begin(peer, B1_HOOK_RECV, NULL);
+        r = b1_peer_recv_internal(peer, messagep);
+        b1_peer_hook_end(peer, B1_HOOK_RECV, r < 0 ? NULL : *messagep, context, r);
+
+        return r;
+}
+
 /**
  * b1_peer_recv_seed() - receive the seed message
  * @peer:               the receiving peer
@@ -401,6 +382,8 @@ _c_public_ int b1_peer_recv_seed(B1Peer *peer, B1Message **seedp) {
         if (r < 0)
                 return r;
 
+        b1_peer_account_dropped(peer, recv.n_dropped);
+
         if (recv.type != BUS1_MSG_DATA)
                 return -EIO;
 
@@ -408,18 +391,43 @@ _c_public_ int b1_peer_recv_seed(B1Peer *peer, B1Message **seedp) {
 }
 
 /**
- * b1_peer_clone() - create a new peer connected to an existing one
+ * b1_peer_get_pool_size_hint() - suggest a pool size based on observed usage
+ * @peer:               peer to query
+ *
+ * This suggests a pool size for peers that serve a similar purpose as @peer,
+ * based on the high-water mark of pool usage observed on @peer. The suggestion
+ * leaves room for four times the high-water mark, rounded up to a power of two,
+ * and is bounded by B1_POOL_SIZE_MIN and the default pool size.
+ *
+ * Return: the suggested pool size in bytes.
+ */
+_c_public_ size_t b1_peer_get_pool_size_hint(B1Peer *peer) {
+        uint64_t size = B1_POOL_SIZE_MIN;
+
+        assert(peer);
+
+        while (size < peer->pool.n_bytes_max * 4 && size < BUS1_CLIENT_POOL_SIZE)
+                size <<= 1;
+
+        return c_min(size, (uint64_t)BUS1_CLIENT_POOL_SIZE);
+}
+
+/**
+ * b1_peer_clone_with_pool() - create a new peer with custom pool connected to an existing one
  * @peer:               existing, parent peer
  * @nodep:              root node of new child peer
  * @handlep:            handle to @nodep in the parent peer
+ * @pool_size:          size of the receive pool, or 0 for the default
+ * @flags:              B1_POOL_FLAG_* flags controlling the pool mapping
  *
- * In order for peers to communicate, they must be reachable from one another.
- * This creates a new peer and gives a handle to it to an existing peer,
- * allowing communication to be established.
+ * This is like b1_peer_clone(), but allows to choose the pool of the new peer
+ * the same way as b1_peer_new_with_pool(). If B1_POOL_FLAG_AUTO_SIZE is given,
+ * the pool size is taken from b1_peer_get_pool_size_hint() on @peer, capped at
+ * @pool_size if non-zero.
  *
  * Return: 0 on success, or a negative error code on failure.
  */
-_c_public_ int b1_peer_clone(B1Peer *peer, B1Node **nodep, B1Handle **handlep) {
+_c_public_ int b1_peer_clone_with_pool(B1Peer *peer, B1Node **nodep, B1Handle **handlep, size_t pool_size, unsigned int flags) {
         _c_cleanup_(b1_peer_unrefp) B1Peer *clone = NULL;
         _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
         _c_cleanup_(b1_node_freep) B1Node *node = NULL;
@@ -430,11 +438,16 @@ _c_public_ int b1_peer_clone(B1Peer *peer, B1Node **nodep, B1Handle **handlep) {
         assert(nodep);
         assert(handlep);
 
-        r = bus1_client_clone(peer->client, &node_id, &handle_id, &fd, BUS1_CLIENT_POOL_SIZE);
+        if (flags & B1_POOL_FLAG_AUTO_SIZE)
+                pool_size = c_min(b1_peer_get_pool_size_hint(peer), pool_size ?: BUS1_CLIENT_POOL_SIZE);
+        else if (!pool_size)
+                pool_size = BUS1_CLIENT_POOL_SIZE;
+
+        r = bus1_client_clone(peer->client, &node_id, &handle_id, &fd, pool_size);
         if (r < 0)
                 return r;
 
-        r = b1_peer_new_from_fd(&clone, fd);
+        r = b1_peer_new_from_fd_internal(&clone, fd, flags);
         if (r < 0)
                 return r;
 
@@ -471,6 +484,342 @@ _c_public_ int b1_peer_clone(B1Peer *peer, B1Node **nodep, B1Handle **handlep) {
         return 0;
 }
 
+void b1_peer_pool_link(B1Peer *peer, B1Message *message, uint64_t n_bytes) {
+        assert(peer);
+        assert(message);
+
+        message->data.n_slice = n_bytes;
+        message->data.recv_time = b1_now_nsec();
+        message->data.pool_linked = true;
+        message->data.pool_next = NULL;
+        message->data.pool_previous = peer->pool.last;
+        if (peer->pool.last)
+                peer->pool.last->data.pool_next = message;
+        else
+                peer->pool.first = message;
+        peer->pool.last = message;
+
+        peer->pool.n_slices += 1;
+        peer->pool.n_bytes += n_bytes;
+        peer->pool.n_slices_max = c_max(peer->pool.n_slices_max, peer->pool.n_slices);
+        peer->pool.n_bytes_max = c_max(peer->pool.n_bytes_max, peer->pool.n_bytes);
+        peer->pool.slice_max = c_max(peer->pool.slice_max, n_bytes);
+}
+
+void b1_peer_pool_unlink(B1Peer *peer, B1Message *message) {
+        assert(peer);
+        assert(message);
+        assert(peer->pool.n_slices > 0);
+
+        if (message->data.pool_previous)
+                message->data.pool_previous->data.pool_next = message->data.pool_next;
+        else
+                peer->pool.first = message->data.pool_next;
+        if (message->data.pool_next)
+                message->data.pool_next->data.pool_previous = message->data.pool_previous;
+        else
+                peer->pool.last = message->data.pool_previous;
+
+        message->data.pool_linked = false;
+        message->data.pool_previous = NULL;
+        message->data.pool_next = NULL;
+
+        peer->pool.n_slices -= 1;
+        peer->pool.n_bytes -= message->data.n_slice;
+}
+
+/**
+ * b1_peer_get_pool_stats() - query pool usage of a peer
+ * @peer:               the peer to query
+ * @statsp:             output argument for the statistics
+ *
+ * Every received message pins a slice in the pool of the receiving peer until
+ * the last reference to the message is dropped. This reports the slices and
+ * bytes currently pinned this way, their high-water marks since the peer was
+ * created, the largest slice ever received, and the age of the oldest message
+ * that is still referenced. Sizes include the trailing handle and fd arrays of
+ * each slice.
+ *
+ * Furthermore, it reports the total number of messages the kernel dropped for
+ * this peer, and the pool usage at the time the latest drop was noticed.
+ */
+_c_public_ void b1_peer_get_pool_stats(B1Peer *peer, B1PoolStats *statsp) {
+        assert(peer);
+        assert(statsp);
+
+        *statsp = (B1PoolStats){
+                .pool_size = bus1_client_get_pool_size(peer->client),
+                .n_slices = peer->pool.n_slices,
+                .n_bytes = peer->pool.n_bytes,
+                .n_slices_max = peer->pool.n_slices_max,
+                .n_bytes_max = peer->pool.n_bytes_max,
+                .slice_max = peer->pool.slice_max,
+                .n_dropped = peer->pool.n_dropped,
+                .n_slices_at_drop = peer->pool.n_slices_at_drop,
+                .n_bytes_at_drop = peer->pool.n_bytes_at_drop,
+        };
+
+        if (peer->pool.first)
+                statsp->oldest_nsec = b1_now_nsec() - peer->pool.first->data.recv_time;
+}
+
+/**
+ * b1_peer_clone() - create a new peer connected to an existing one
+ * @peer:               existing, parent peer
+ * @nodep:              root node of new child peer
+ * @handlep:            handle to @nodep in the parent peer
+ *
+ * In order for peers to communicate, they must be reachable from one another.
+ * This creates a new peer and gives a handle to it to an existing peer,
+ * allowing communication to be established.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_peer_clone(B1Peer *peer, B1Node **nodep, B1Handle **handlep) {
+        return b1_peer_clone_with_pool(peer, nodep, handlep, 0, 0);
+}
+
+/**
+ * b1_peer_set_ioctl_stats() - enable or disable kernel call statistics
+ * @peer:               peer to operate on
+ * @enable:             whether to collect statistics
+ *
+ * If enabled, every ioctl issued on behalf of @peer is counted and timed, per
+ * command, and failures are counted per errno. Disabling stops collection but
+ * retains the statistics gathered so far. While disabled, the overhead is a
+ * single branch per kernel call.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_peer_set_ioctl_stats(B1Peer *peer, bool enable) {
+        assert(peer);
+
+        return bus1_client_set_stats(peer->client, enable);
+}
+
+/**
+ * b1_peer_get_ioctl_stats() - query kernel call statistics
+ * @peer:               peer to query
+ * @statsp:             output argument for the statistics
+ *
+ * This returns a snapshot of the statistics collected while enabled via
+ * b1_peer_set_ioctl_stats(). Commands are indexed by B1_IOCTL_*, and latencies
+ * are counted in log2 buckets of nanoseconds, bucket N covering [2^N, 2^(N+1)).
+ * Errors are counted per errno, up to B1_IOCTL_STATS_ERRNO_MAX.
+ */
+_c_public_ void b1_peer_get_ioctl_stats(B1Peer *peer, B1IoctlStats *statsp) {
+        struct bus1_client_stats stats;
+
+        static_assert(_B1_IOCTL_N <= BUS1_CLIENT_STATS_CMD_MAX,
+                      "ioctl statistics cannot hold all commands");
+        static_assert(B1_IOCTL_STATS_BUCKETS == BUS1_CLIENT_STATS_BUCKETS,
+                      "ioctl statistics bucket mismatch");
+        static_assert(B1_IOCTL_STATS_ERRNO_MAX == BUS1_CLIENT_STATS_ERRNO_MAX,
+                      "ioctl statistics errno mismatch");
+        static_assert(_IOC_NR(BUS1_CMD_RECV) == B1_IOCTL_RECV,
+                      "ioctl statistics index mismatch");
+
+        assert(peer);
+        assert(statsp);
+
+        bus1_client_get_stats(peer->client, &stats);
+
+        for (unsigned int i = 0; i < _B1_IOCTL_N; i++) {
+                statsp->cmds[i].n_calls = stats.cmds[i].n_calls;
+                statsp->cmds[i].n_errors = stats.cmds[i].n_errors;
+                statsp->cmds[i].total_nsec = stats.cmds[i].total_nsec;
+                memcpy(statsp->cmds[i].latency, stats.cmds[i].latency,
+                       sizeof(statsp->cmds[i].latency));
+        }
+
+        memcpy(statsp->errnos, stats.errnos, sizeof(statsp->errnos));
+}
+
+/**
+ * b1_peer_set_dispatch_stats() - enable or disable dispatch statistics
+ * @peer:               peer to operate on
+ * @enable:             whether to collect statistics
+ *
+ * If enabled, every call dispatched by @peer records the run-time of the
+ * member function, and the time the message spent between being received
+ * and being dispatched, in histograms of the member. As interfaces may be
+ * shared between peers, so are their statistics. See b1_interface_get_stats().
+ * While disabled, the overhead is a single branch per dispatched call.
+ */
+_c_public_ void b1_peer_set_dispatch_stats(B1Peer *peer, bool enable) {
+        assert(peer);
+
+        peer->dispatch_stats = enable;
+}
+
+/**
+ * b1_peer_set_send_timestamps() - enable or disable send timestamps
+ * @peer:               peer to operate on
+ * @enable:             whether to stamp sent messages
+ *
+ * If enabled, every message sent by @peer carries the time it was handed to
+ * the kernel, so the receiver can tell the time a message spent queued from
+ * the time spent handling it. See b1_message_get_queue_delay(). This costs
+ * eight bytes per message. Receivers running an older version of this library
+ * will reject stamped messages.
+ */
+_c_public_ void b1_peer_set_send_timestamps(B1Peer *peer, bool enable) {
+        assert(peer);
+
+        peer->send_timestamps = enable;
+}
+
+/**
+ * b1_peer_set_coalesce_threshold() - set threshold to coalesce vectors at
+ * @peer:               peer to operate on
+ * @threshold:          size in bytes, or 0 to disable
+ *
+ * Messages are handed to the kernel as vectors, which are copied one by one.
+ * Messages built from many small pieces, e.g., via b1_message_insert(), are
+ * cheaper to send if adjacent vectors smaller than @threshold are first copied
+ * into a single one. Larger vectors are always passed by reference.
+ *
+ * Regardless of this setting, vectors are coalesced as needed to stay within
+ * the kernel limit of BUS1_VEC_MAX vectors per message.
+ */
+_c_public_ void b1_peer_set_coalesce_threshold(B1Peer *peer, size_t threshold) {
+        assert(peer);
+
+        peer->coalesce.threshold = threshold;
+}
+
+/**
+ * b1_peer_get_coalesced_bytes() - query number of coalesced bytes
+ * @peer:               peer to query
+ *
+ * Return: the number of bytes copied to coalesce vectors of sent messages.
+ */
+_c_public_ uint64_t b1_peer_get_coalesced_bytes(B1Peer *peer) {
+        assert(peer);
+
+        return peer->coalesce.n_bytes;
+}
+
+/**
+ * b1_peer_set_hooks() - set functions to call around message operations
+ * @peer:               peer to operate on
+ * @hooks:              hooks to set, or NULL to remove them
+ * @userdata:           userdata to pass to the hooks
+ *
+ * The begin hook is called right before @peer sends, receives or dispatches a
+ * message, and the end hook right after. The event is one of B1_HOOK_SEND,
+ * B1_HOOK_RECV or B1_HOOK_DISPATCH. Whatever the begin hook returns is passed
+ * as context to the matching end hook, along with the result of the
+ * operation. When receiving, the begin hook is passed NULL as message, and the
+ * end hook the received message, or NULL on failure. Either hook may be NULL.
+ *
+ * Hooks are copied, so @hooks need not stay valid. While no hooks are set, the
+ * overhead is a single branch per operation.
+ */
+_c_public_ void b1_peer_set_hooks(B1Peer *peer, const B1PeerHooks *hooks, void *userdata) {
+        assert(peer);
+
+        if (hooks) {
+                peer->hooks = *hooks;
+                peer->hooks_userdata = userdata;
+        } else {
+                peer->hooks = (B1PeerHooks){};
+                peer->hooks_userdata = NULL;
+        }
+
+        peer->hooked = peer->hooks.begin || peer->hooks.end;
+}
+
+/**
+ * b1_peer_set_recorder() - enable or disable the flight recorder
+ * @peer:               peer to operate on
+ * @n_records:          number of records to keep, or 0 to disable
+ *
+ * The flight recorder keeps compact metadata of the last @n_records messages
+ * sent, received and dispatched by @peer, to be inspected after the fact with
+ * b1_peer_get_records() or b1_peer_dump_records(). @n_records is rounded up to
+ * a power of two. Any previously recorded entries are discarded. While
+ * disabled, the overhead is a single branch per message.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_peer_set_recorder(B1Peer *peer, size_t n_records) {
+        B1Recorder *recorder = NULL;
+
+        assert(peer);
+
+        if (n_records > 0) {
+                recorder = b1_recorder_new(n_records);
+                if (!recorder)
+                        return -ENOMEM;
+        }
+
+        b1_recorder_free(peer->recorder);
+        peer->recorder = recorder;
+
+        return 0;
+}
+
+/**
+ * b1_peer_get_records() - copy the most recent records of the flight recorder
+ * @peer:               peer to query
+ * @records:            array to copy the records to
+ * @n_records:          size of @records
+ *
+ * Copies up to @n_records of the most recent records, oldest first. Records
+ * being overwritten concurrently are skipped. This never blocks the thread
+ * operating @peer.
+ *
+ * Return: the number of records copied.
+ */
+_c_public_ size_t b1_peer_get_records(B1Peer *peer, B1Record *records, size_t n_records) {
+        assert(peer);
+        assert(!n_records || records);
+
+        if (!peer->recorder)
+                return 0;
+
+        return b1_recorder_copy(peer->recorder, records, n_records);
+}
+
+/**
+ * b1_peer_dump_records() - write the flight recorder to a file descriptor
+ * @peer:               peer to dump
+ * @fd:                 file descriptor to write to
+ *
+ * Writes all records, oldest first, one line of text per record. This is
+ * async-signal-safe, so it may be called from a signal handler, as long as
+ * the recorder is not disabled or resized concurrently.
+ *
+ * Return: 0 on success, or a negative error code on failure.
+ */
+_c_public_ int b1_peer_dump_records(B1Peer *peer, int fd) {
+        assert(peer);
+
+        if (!peer->recorder)
+                return 0;
+
+        return b1_recorder_dump(peer->recorder, fd);
+}
+
+/**
+ * b1_peer_set_drop_fn() - set function to call when messages were dropped
+ * @peer:               peer to operate on
+ * @fn:                 function callback to set, or NULL
+ * @userdata:           userdata to pass to @fn
+ *
+ * When the kernel cannot queue messages for @peer, it drops them and reports
+ * the number of dropped messages on the next receive operation. This sets a
+ * function to be called with that number whenever it is non-zero, which can
+ * be used to shed load. If NULL, the functionality is disabled.
+ */
+_c_public_ void b1_peer_set_drop_fn(B1Peer *peer, B1PeerDropFn fn, void *userdata) {
+        assert(peer);
+
+        peer->drop_fn = fn;
+        peer->drop_userdata = userdata;
+}
+
 B1Node *b1_peer_get_root_node(B1Peer *peer, const char *name) {
         CRBNode *n;
 
@@ -16,6 +16,7 @@
 ***/
 
 #include <c-rbtree.h>
+#include <time.h>
 #include "bus1-client.h"
 #include "org.bus1/b1-peer.h"
 
@@ -27,8 +28,67 @@ struct B1Peer {
         CRBTree nodes;
         CRBTree handles;
         CRBTree root_nodes;
+
+        struct {
+                uint64_t n_slices;
+                uint64_t n_bytes;
+                uint64_t n_slices_max;
+                uint64_t n_bytes_max;
+                uint64_t slice_max;
+                B1Message *first; /* oldest outstanding message */
+                B1Message *last;
+
+                uint64_t n_dropped;
+                uint64_t n_slices_at_drop;
+                uint64_t n_bytes_at_drop;
+        } pool;
+
+        B1PeerDropFn drop_fn;
+        void *drop_userdata;
+
+        bool dispatch_stats;
+        bool send_timestamps;
+
+        bool hooked;
+        B1PeerHooks hooks;
+        void *hooks_userdata;
+
+        struct {
+                size_t threshold;
+                uint64_t n_bytes;
+                struct iovec *vecs;
+                void *buffer;
+                size_t n_buffer;
+        } coalesce;
+
+        struct B1Recorder *recorder;
+        struct B1MessageErrors *errors;
+        unsigned long n_cached;         /* references held by @errors */
 };
 
+static inline uint64_t b1_now_nsec(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static inline void *b1_peer_hook_begin(B1Peer *peer, unsigned int event, B1Message *message) {
+        if (!peer->hooks.begin)
+                return NULL;
+
+        return peer->hooks.begin(peer, peer->hooks_userdata, event, message);
+}
+
+static inline void b1_peer_hook_end(B1Peer *peer, unsigned int event, B1Message *message, void *context, int result) {
+        if (peer->hooks.end)
+                peer->hooks.end(peer, peer->hooks_userdata, event, message, context, result);
+}
+
 B1Node *b1_peer_get_node(B1Peer *peer, uint64_t node_id);
 B1Handle *b1_peer_get_handle(B1Peer *peer, uint64_t handle_id);
 B1Node *b1_peer_get_root_node(B1Peer *peer, const char *name);
+
+void b1_peer_pool_link(B1Peer *peer, B1Message *message, uint64_t n_bytes);
+void b1_peer_pool_unlink(B1Peer *peer, B1Message *message);
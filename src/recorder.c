@@ -0,0 +1,254 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Flight Recorder
+ *
+ * A recorder is a ring of the most recent message events of a peer. It has a
+ * single writer, the thread operating the peer, and any number of readers,
+ * which may run concurrently, including from signal handlers.
+ *
+ * Every entry is protected by its own sequence count: the writer makes it odd
+ * before and even again after modifying the entry. Readers copy an entry and
+ * discard the copy if the count was odd or changed meanwhile. Neither side
+ * ever blocks, and an entry is at worst missing from a dump.
+ */
+
+#include <assert.h>
+#include <c-macro.h>
+#include <errno.h>
+#include "message.h"
+#include "peer.h"
+#include "recorder.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct B1RecorderEntry {
+        uint64_t seq;
+        B1Record record;
+} B1RecorderEntry;
+
+struct B1Recorder {
+        uint64_t mask;
+        uint64_t head;
+        B1RecorderEntry entries[];
+};
+
+B1Recorder *b1_recorder_new(size_t n_records) {
+        B1Recorder *recorder;
+        size_t n = 1;
+
+        assert(n_records > 0);
+
+        while (n < n_records)
+                n <<= 1;
+
+        recorder = calloc(1, sizeof(*recorder) + n * sizeof(*recorder->entries));
+        if (!recorder)
+                return NULL;
+
+        recorder->mask = n - 1;
+
+        return recorder;
+}
+
+B1Recorder *b1_recorder_free(B1Recorder *recorder) {
+        free(recorder);
+
+        return NULL;
+}
+
+static void b1_recorder_copy_name(char *dst, const char *src) {
+        size_t n;
+
+        if (!src) {
+                dst[0] = 0;
+                return;
+        }
+
+        n = strnlen(src, B1_RECORD_NAME_MAX - 1);
+        memcpy(dst, src, n);
+        dst[n] = 0;
+}
+
+void b1_recorder_record(B1Recorder *recorder,
+                        unsigned int kind,
+                        B1Message *message,
+                        uint64_t destination,
+                        uint64_t n_bytes,
+                        uint64_t duration_nsec,
+                        int result) {
+        B1RecorderEntry *entry;
+        B1Record *record;
+        uint64_t seq;
+
+        entry = &recorder->entries[recorder->head & recorder->mask];
+        record = &entry->record;
+
+        seq = entry->seq;
+        __atomic_store_n(&entry->seq, seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        record->timestamp = b1_now_nsec();
+        record->destination = destination;
+        record->n_bytes = n_bytes;
+        record->duration_nsec = duration_nsec;
+        record->result = result;
+        record->kind = kind;
+        record->type = message->type;
+        record->n_handles = c_min(message->data.n_handles, (size_t)UINT16_MAX);
+        record->n_fds = c_min(message->data.n_fds, (size_t)UINT16_MAX);
+
+        /* names are only known for received calls */
+        if (message->type == B1_MESSAGE_TYPE_CALL && message->data.slice) {
+                b1_recorder_copy_name(record->interface, message->data.call.interface);
+                b1_recorder_copy_name(record->member, message->data.call.member);
+        } else {
+                record->interface[0] = 0;
+                record->member[0] = 0;
+        }
+
+        __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&recorder->head, recorder->head + 1, __ATOMIC_RELEASE);
+}
+
+static bool b1_recorder_read(B1Recorder *recorder, uint64_t index, B1Record *record) {
+        B1RecorderEntry *entry = &recorder->entries[index & recorder->mask];
+        uint64_t seq;
+
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+                return false;
+
+        memcpy(record, &entry->record, sizeof(*record));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        return __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq;
+}
+
+size_t b1_recorder_copy(B1Recorder *recorder, B1Record *records, size_t n_records) {
+        uint64_t head, first;
+        size_t n = 0;
+
+        head = __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE);
+        first = head - c_min(head, c_min((uint64_t)n_records, recorder->mask + 1));
+
+        for (uint64_t i = first; i < head; ++i)
+                if (b1_recorder_read(recorder, i, &records[n]))
+                        ++n;
+
+        return n;
+}
+
+/*
+ * Minimal formatting into a fixed buffer, as snprintf() is not
+ * async-signal-safe.
+ */
+static size_t b1_recorder_put_str(char *buf, size_t i, size_t n_buf, const char *str) {
+        while (*str && i < n_buf)
+                buf[i++] = *str++;
+
+        return i;
+}
+
+static size_t b1_recorder_put_u64(char *buf, size_t i, size_t n_buf, uint64_t value) {
+        char digits[20];
+        size_t n = 0;
+
+        do {
+                digits[n++] = '0' + value % 10;
+                value /= 10;
+        } while (value);
+
+        while (n && i < n_buf)
+                buf[i++] = digits[--n];
+
+        return i;
+}
+
+static size_t b1_recorder_put_i64(char *buf, size_t i, size_t n_buf, int64_t value) {
+        if (value < 0) {
+                i = b1_recorder_put_str(buf, i, n_buf, "-");
+                return b1_recorder_put_u64(buf, i, n_buf, -(uint64_t)value);
+        }
+
+        return b1_recorder_put_u64(buf, i, n_buf, value);
+}
+
+int b1_recorder_dump(B1Recorder *recorder, int fd) {
+        static const char * const kinds[] = {
+                [B1_RECORD_SEND] = "send",
+                [B1_RECORD_RECV] = "recv",
+                [B1_RECORD_DISPATCH] = "dispatch",
+        };
+        uint64_t head, first;
+        B1Record record;
+        char buf[256];
+        size_t i;
+        ssize_t l;
+
+        head = __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE);
+        first = head - c_min(head, recorder->mask + 1);
+
+        for (uint64_t index = first; index < head; ++index) {
+                if (!b1_recorder_read(recorder, index, &record))
+                        continue;
+
+                i = b1_recorder_put_u64(buf, 0, sizeof(buf), record.timestamp);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " ");
+                i = b1_recorder_put_str(buf, i, sizeof(buf),
+                                        record.kind < C_ARRAY_SIZE(kinds) ? kinds[record.kind] : "?");
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " type=");
+                i = b1_recorder_put_u64(buf, i, sizeof(buf), record.type);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " destination=");
+                i = b1_recorder_put_u64(buf, i, sizeof(buf), record.destination);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " bytes=");
+                i = b1_recorder_put_u64(buf, i, sizeof(buf), record.n_bytes);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " handles=");
+                i = b1_recorder_put_u64(buf, i, sizeof(buf), record.n_handles);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " fds=");
+                i = b1_recorder_put_u64(buf, i, sizeof(buf), record.n_fds);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " result=");
+                i = b1_recorder_put_i64(buf, i, sizeof(buf), record.result);
+                i = b1_recorder_put_str(buf, i, sizeof(buf), " duration=");
+                i = b1_recorder_put_u64(buf, i, sizeof(buf), record.duration_nsec);
+
+                if (record.interface[0]) {
+                        i = b1_recorder_put_str(buf, i, sizeof(buf), " ");
+                        i = b1_recorder_put_str(buf, i, sizeof(buf), record.interface);
+                        i = b1_recorder_put_str(buf, i, sizeof(buf), ".");
+                        i = b1_recorder_put_str(buf, i, sizeof(buf), record.member);
+                }
+
+                i = c_min(i, sizeof(buf) - 1);
+                buf[i++] = '\n';
+
+                for (size_t n = 0; n < i; n += l) {
+                        l = write(fd, buf + n, i - n);
+                        if (l < 0) {
+                                if (errno == EINTR) {
+                                        l = 0;
+                                        continue;
+                                }
+                                return -errno;
+                        }
+                }
+        }
+
+        return 0;
+}
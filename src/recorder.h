@@ -0,0 +1,34 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+#include "org.bus1/b1-peer.h"
+
+typedef struct B1Recorder B1Recorder;
+
+B1Recorder *b1_recorder_new(size_t n_records);
+B1Recorder *b1_recorder_free(B1Recorder *recorder);
+
+void b1_recorder_record(B1Recorder *recorder,
+                        unsigned int kind,
+                        B1Message *message,
+                        uint64_t destination,
+                        uint64_t n_bytes,
+                        uint64_t duration_nsec,
+                        int result);
+size_t b1_recorder_copy(B1Recorder *recorder, B1Record *records, size_t n_records);
+int b1_recorder_dump(B1Recorder *recorder, int fd);
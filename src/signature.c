@@ -0,0 +1,479 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Signatures
+ *
+ * A signature object is a validated GVariant type string, compiled once into
+ * a flat type tree. Every complete type in the tree carries its alignment and,
+ * if it is of fixed size, its size and the offset within its parent. This is
+ * the layout GVariant mandates, which matches the layout of the equivalent C
+ * structure.
+ *
+ * Signature objects are immutable, hence they can be shared between threads
+ * and are reference counted atomically. They are interned in a process-wide
+ * table, so every signature is compiled only once and equal signatures can be
+ * compared by pointer. The table only references its entries weakly, they are
+ * removed once their last reference is dropped.
+ */
+
+#include <assert.h>
+#include <c-macro.h>
+#include <errno.h>
+#include <pthread.h>
+#include "signature.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int b1_signature_compile_type(B1Signature *signature, size_t *posp, unsigned int depth);
+
+static int b1_signature_compile_sequence(B1Signature *signature,
+                                         size_t *posp,
+                                         char end,
+                                         unsigned int depth,
+                                         size_t *n_typesp,
+                                         size_t *alignmentp,
+                                         size_t *sizep) {
+        size_t pos = *posp, n_types = 0, alignment = 1, offset = 0;
+        bool fixed = true;
+        int r;
+
+        for (;;) {
+                B1SignatureType *type;
+
+                if (pos == signature->n_string) {
+                        if (end)
+                                return -EINVAL;
+                        break;
+                }
+
+                if (signature->string[pos] == end)
+                        break;
+
+                type = &signature->types[pos];
+                r = b1_signature_compile_type(signature, &pos, depth);
+                if (r < 0)
+                        return r;
+
+                ++n_types;
+                alignment = c_max(alignment, type->alignment);
+
+                if (fixed && type->size) {
+                        offset = c_align_to(offset, type->alignment);
+                        type->offset = offset;
+                        offset += type->size;
+                } else {
+                        fixed = false;
+                }
+        }
+
+        *posp = pos;
+        *n_typesp = n_types;
+        *alignmentp = alignment;
+        *sizep = fixed ? c_align_to(offset, alignment) : 0;
+
+        return 0;
+}
+
+static int b1_signature_compile_type(B1Signature *signature, size_t *posp, unsigned int depth) {
+        const char *string = signature->string;
+        size_t pos = *posp, n_types, alignment, size;
+        B1SignatureType *type;
+        int r;
+
+        if (depth > B1_SIGNATURE_DEPTH_MAX || pos >= signature->n_string)
+                return -EINVAL;
+
+        type = &signature->types[pos];
+        type->element = string[pos];
+        type->offset = 0;
+
+        switch (string[pos++]) {
+        case 'b':
+        case 'y':
+                alignment = 1;
+                size = 1;
+                break;
+        case 'n':
+        case 'q':
+                alignment = 2;
+                size = 2;
+                break;
+        case 'i':
+        case 'u':
+        case 'h':
+                alignment = 4;
+                size = 4;
+                break;
+        case 'x':
+        case 't':
+        case 'd':
+                alignment = 8;
+                size = 8;
+                break;
+        case 's':
+        case 'o':
+        case 'g':
+                alignment = 1;
+                size = 0;
+                break;
+        case 'v':
+                alignment = 8;
+                size = 0;
+                break;
+        case 'a':
+        case 'm':
+                r = b1_signature_compile_type(signature, &pos, depth + 1);
+                if (r < 0)
+                        return r;
+
+                alignment = signature->types[*posp + 1].alignment;
+                size = 0;
+                break;
+        case '(':
+                r = b1_signature_compile_sequence(signature, &pos, ')', depth + 1,
+                                                  &n_types, &alignment, &size);
+                if (r < 0)
+                        return r;
+
+                /* the unit type still occupies a single byte */
+                if (n_types == 0)
+                        size = 1;
+
+                ++pos;
+                break;
+        case '{':
+                /* the key of a dict entry must be a basic type */
+                if (pos >= signature->n_string || !strchr("bynqiuxthdsog", string[pos]))
+                        return -EINVAL;
+
+                r = b1_signature_compile_sequence(signature, &pos, '}', depth + 1,
+                                                  &n_types, &alignment, &size);
+                if (r < 0)
+                        return r;
+                if (n_types != 2)
+                        return -EINVAL;
+
+                ++pos;
+                break;
+        default:
+                return -EINVAL;
+        }
+
+        type->alignment = alignment;
+        type->size = size;
+        type->n_type = pos - *posp;
+
+        *posp = pos;
+        return 0;
+}
+
+static void b1_signature_pack_type(B1Signature *signature, size_t pos, uint8_t *p, va_list *args) {
+        B1SignatureType *type = &signature->types[pos];
+        size_t end;
+
+        p += type->offset;
+
+        switch (type->element) {
+        case 'b':
+                *p = !!va_arg(*args, int);
+                break;
+        case 'y':
+                *p = va_arg(*args, int);
+                break;
+        case 'n':
+        case 'q':
+                *(uint16_t *)p = va_arg(*args, int);
+                break;
+        case 'i':
+        case 'u':
+        case 'h':
+                *(uint32_t *)p = va_arg(*args, uint32_t);
+                break;
+        case 'x':
+        case 't':
+                *(uint64_t *)p = va_arg(*args, uint64_t);
+                break;
+        case 'd':
+                *(double *)p = va_arg(*args, double);
+                break;
+        case '(':
+        case '{':
+                end = pos + type->n_type - 1;
+                for (pos += 1; pos < end; pos += signature->types[pos].n_type)
+                        b1_signature_pack_type(signature, pos, p, args);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+/*
+ * Serialize the arguments @args according to the fixed-size signature
+ * @signature into @buffer, which must be zeroed, aligned to 8 bytes and be
+ * at least of the size of the signature.
+ */
+void b1_signature_pack(B1Signature *signature, void *buffer, va_list args) {
+        va_list copy;
+        size_t pos;
+
+        assert(signature->size > 0);
+
+        va_copy(copy, args);
+        for (pos = 0; pos < signature->n_string; pos += signature->types[pos].n_type)
+                b1_signature_pack_type(signature, pos, buffer, &copy);
+        va_end(copy);
+}
+
+typedef struct B1SignatureKey {
+        const char *string;
+        size_t n_string;
+} B1SignatureKey;
+
+static pthread_mutex_t b1_signature_lock = PTHREAD_MUTEX_INITIALIZER;
+static CRBTree b1_signature_tree;
+
+/*
+ * Every reply slot and member without payload holds the empty signature. It
+ * is not in the table, but allocated statically with a reference that is never
+ * released, so holding it never compiles it anew.
+ */
+static char b1_signature_empty_string[1];
+static B1Signature b1_signature_empty = {
+        .n_ref = 1,
+        .alignment = 1,
+        .string = b1_signature_empty_string,
+};
+
+static int signatures_compare(CRBTree *t, void *k, CRBNode *n) {
+        B1Signature *signature = c_container_of(n, B1Signature, rb);
+        B1SignatureKey *key = k;
+
+        if (key->n_string != signature->n_string)
+                return key->n_string < signature->n_string ? -1 : 1;
+
+        return memcmp(key->string, signature->string, key->n_string);
+}
+
+static int b1_signature_compile(B1Signature **signaturep, const char *string, size_t n_string) {
+        B1Signature *signature;
+        size_t pos = 0;
+        int r;
+
+        /* the type string must not be truncated by an embedded NUL */
+        if (memchr(string, '\0', n_string))
+                return -EINVAL;
+
+        signature = malloc(sizeof(*signature) + n_string * sizeof(*signature->types) + n_string + 1);
+        if (!signature)
+                return -ENOMEM;
+
+        signature->n_ref = 1;
+        c_rbnode_init(&signature->rb);
+        signature->n_string = n_string;
+        signature->string = (void *)(signature->types + n_string);
+        memcpy(signature->string, string, n_string);
+        signature->string[n_string] = '\0';
+
+        r = b1_signature_compile_sequence(signature, &pos, '\0', 0,
+                                          &signature->n_types,
+                                          &signature->alignment,
+                                          &signature->size);
+        if (r < 0) {
+                free(signature);
+                return r;
+        }
+
+        *signaturep = signature;
+        return 0;
+}
+
+/*
+ * Return a reference to the signature object for the first @n_string
+ * characters of @string, compiling and adding it to the process-wide table of
+ * signatures if it does not exist yet. Equal signatures are therefore always
+ * represented by the same object, and can be compared by pointer.
+ */
+int b1_signature_intern(B1Signature **signaturep, const char *string, size_t n_string) {
+        B1SignatureKey key = { string, n_string };
+        B1Signature *signature;
+        CRBNode **slot, *p;
+        int r = 0;
+
+        if (n_string == 0) {
+                *signaturep = b1_signature_ref(&b1_signature_empty);
+                return 0;
+        }
+
+        pthread_mutex_lock(&b1_signature_lock);
+
+        p = c_rbtree_find_node(&b1_signature_tree, signatures_compare, &key);
+        if (p) {
+                signature = b1_signature_ref(c_container_of(p, B1Signature, rb));
+        } else {
+                r = b1_signature_compile(&signature, string, n_string);
+                if (r >= 0) {
+                        slot = c_rbtree_find_slot(&b1_signature_tree, signatures_compare, &key, &p);
+                        c_rbtree_add(&b1_signature_tree, p, slot, &signature->rb);
+                }
+        }
+
+        pthread_mutex_unlock(&b1_signature_lock);
+
+        if (r < 0)
+                return r;
+
+        *signaturep = signature;
+        return 0;
+}
+
+/*
+ * The empty structure is left out of messages, so payloads of either type are
+ * equivalent. Payloads are validated against the signature returned by these
+ * helpers, which maps the empty structure to the empty signature.
+ */
+static bool b1_signature_is_unit(const char *string, size_t n_string) {
+        return n_string == 2 && string[0] == '(' && string[1] == ')';
+}
+
+int b1_signature_ref_payload(B1Signature *signature, B1Signature **payloadp) {
+        if (b1_signature_is_unit(signature->string, signature->n_string))
+                return b1_signature_intern(payloadp, "", 0);
+
+        *payloadp = b1_signature_ref(signature);
+        return 0;
+}
+
+/*
+ * Payloads are checked on every dispatch, so this compares the strings rather
+ * than looking up @string in the table. Interning or hashing @string would read
+ * all of it as well, and the lookup would take the lock on top. The length is
+ * compared first, so mismatches are usually rejected without reading @string.
+ */
+bool b1_signature_matches_payload(B1Signature *signature, const char *string, size_t n_string) {
+        if (b1_signature_is_unit(string, n_string))
+                n_string = 0;
+
+        return n_string == signature->n_string && !memcmp(string, signature->string, n_string);
+}
+
+/**
+ * b1_signature_new() - compile a signature
+ * @signaturep:         pointer to the new signature object
+ * @string:             a GVariant type string
+ *
+ * Validate and compile @string, which may consist of any number of complete
+ * types. The resulting object can be passed to the *_signature() variants of
+ * the message functions in place of the string, which saves them from
+ * validating the string and allows fixed-size payloads to be serialized
+ * directly.
+ *
+ * Signatures are interned: equal strings yield references to the same object.
+ *
+ * Return: 0 on success, -EINVAL if @string is not a valid signature, or a
+ *         negative error code on failure.
+ */
+_c_public_ int b1_signature_new(B1Signature **signaturep, const char *string) {
+        assert(signaturep);
+        assert(string);
+
+        return b1_signature_intern(signaturep, string, strlen(string));
+}
+
+/**
+ * b1_signature_ref() - acquire reference
+ * @signature:          signature to acquire reference to, or NULL
+ *
+ * Return: @signature is returned.
+ */
+_c_public_ B1Signature *b1_signature_ref(B1Signature *signature) {
+        if (signature)
+                __atomic_add_fetch(&signature->n_ref, 1, __ATOMIC_RELAXED);
+
+        return signature;
+}
+
+/**
+ * b1_signature_unref() - release reference
+ * @signature:          signature to release reference to, or NULL
+ *
+ * Return: NULL is returned.
+ */
+_c_public_ B1Signature *b1_signature_unref(B1Signature *signature) {
+        unsigned long n_ref;
+
+        if (!signature)
+                return NULL;
+
+        /*
+         * Only the last reference is dropped under the lock, so signatures
+         * found in the table always have a reference left.
+         */
+        n_ref = __atomic_load_n(&signature->n_ref, __ATOMIC_RELAXED);
+        while (n_ref > 1)
+                if (__atomic_compare_exchange_n(&signature->n_ref, &n_ref, n_ref - 1, false,
+                                                __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                        return NULL;
+
+        pthread_mutex_lock(&b1_signature_lock);
+
+        if (__atomic_sub_fetch(&signature->n_ref, 1, __ATOMIC_ACQ_REL) == 0)
+                c_rbtree_remove(&b1_signature_tree, &signature->rb);
+        else
+                signature = NULL;
+
+        pthread_mutex_unlock(&b1_signature_lock);
+
+        free(signature);
+
+        return NULL;
+}
+
+/**
+ * b1_signature_get_string() - get signature string
+ * @signature:          the signature
+ * @n_stringp:          pointer to the length of the string, or NULL
+ *
+ * Return: the type string the signature was compiled from.
+ */
+_c_public_ const char *b1_signature_get_string(B1Signature *signature, size_t *n_stringp) {
+        if (n_stringp)
+                *n_stringp = signature->n_string;
+
+        return signature->string;
+}
+
+/**
+ * b1_signature_get_alignment() - get signature alignment
+ * @signature:          the signature
+ *
+ * Return: the alignment of the sequence of types, in bytes.
+ */
+_c_public_ size_t b1_signature_get_alignment(B1Signature *signature) {
+        return signature->alignment;
+}
+
+/**
+ * b1_signature_get_size() - get size of fixed-size signatures
+ * @signature:          the signature
+ *
+ * Return: the size of the serialized sequence of types in bytes, or 0 if it
+ *         is not of fixed size.
+ */
+_c_public_ size_t b1_signature_get_size(B1Signature *signature) {
+        return signature->size;
+}
@@ -0,0 +1,57 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <c-rbtree.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include "org.bus1/b1-peer.h"
+
+#define B1_SIGNATURE_DEPTH_MAX (64)
+
+/*
+ * A compiled type. There is one entry per character of the signature string,
+ * but only entries at the start of a complete type are used. The type spans
+ * @n_type characters, so its next sibling is found at the entry following
+ * it. @offset is relative to the start of the parent container, and only
+ * valid if the parent is of fixed size.
+ */
+typedef struct B1SignatureType {
+        size_t size;
+        size_t offset;
+        size_t n_type;
+        uint8_t alignment;
+        char element;
+} B1SignatureType;
+
+struct B1Signature {
+        unsigned long n_ref;
+        CRBNode rb;
+
+        size_t n_types;
+        size_t alignment;
+        size_t size;
+
+        size_t n_string;
+        char *string;
+
+        B1SignatureType types[];
+};
+
+int b1_signature_intern(B1Signature **signaturep, const char *string, size_t n_string);
+int b1_signature_ref_payload(B1Signature *signature, B1Signature **payloadp);
+bool b1_signature_matches_payload(B1Signature *signature, const char *string, size_t n_string);
+void b1_signature_pack(B1Signature *signature, void *buffer, va_list args);
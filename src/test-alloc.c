@@ -0,0 +1,260 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Allocation Budgets
+ *
+ * This runs the steady-state message paths and verifies that none of them
+ * allocates more than its budget. Each operation is run a couple of times to
+ * warm up, then every further run must stay within the budget, and a full
+ * round-trip must free everything it allocated.
+ *
+ * Budgets are split into the allocations done by libbus1 itself, and the ones
+ * done by c-variant on its behalf. If a change legitimately needs more
+ * allocations, the budget must be raised in the same change.
+ */
+
+#undef NDEBUG
+#include <c-macro.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "org.bus1/b1-peer.h"
+#include "test-alloc.h"
+
+#define TEST_WARMUP (4)
+#define TEST_RUNS (16)
+
+/* c_variant_new() plus the initial front buffer of the writer */
+#define TEST_CV_WRITER (2)
+/* c_variant_new_from_vecs() */
+#define TEST_CV_READER (1)
+
+/* reply slot, its node and handle; message; handle array; send ids (the "()"
+ * reply signature of the slot is static, see b1_signature_intern()) */
+#define TEST_BUDGET_CALL (6 + TEST_CV_WRITER)
+/* message, handle array, reply handle; reply message and send ids */
+#define TEST_BUDGET_DISPATCH (3 + TEST_CV_READER + 2 + TEST_CV_WRITER)
+/* message, empty handle array */
+#define TEST_BUDGET_REPLY (2 + TEST_CV_READER)
+/* message, handle array, send ids; received message and handle array */
+#define TEST_BUDGET_HANDLE (3 + TEST_CV_WRITER + 2 + TEST_CV_READER)
+
+typedef struct Test {
+        B1Peer *peer;
+        B1Peer *clone;
+        B1Node *node;
+        B1Handle *handle;
+        B1Interface *interface;
+        B1Node *passed;                 /* node of @peer, passed to @clone */
+        B1Handle *received;             /* handle of @clone to @passed */
+        B1ReplySlot *slot;
+        bool done;
+} Test;
+
+typedef struct TestCount {
+        uint64_t n_allocs;
+        uint64_t n_frees;
+} TestCount;
+
+static void test_count_begin(TestCount *count) {
+        count->n_allocs = test_alloc_get_allocs();
+        count->n_frees = test_alloc_get_frees();
+}
+
+static void test_count_end(TestCount *count) {
+        count->n_allocs = test_alloc_get_allocs() - count->n_allocs;
+        count->n_frees = test_alloc_get_frees() - count->n_frees;
+}
+
+static int test_member_fn(B1Node *node, void *userdata, B1Message *message) {
+        _c_cleanup_(b1_message_unrefp) B1Message *reply = NULL;
+        int r;
+
+        r = b1_message_new_reply(b1_node_get_peer(node), &reply, "", "", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_reply(message, reply);
+        assert(r >= 0);
+
+        return 0;
+}
+
+static int test_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+        Test *test = userdata;
+
+        test->done = true;
+
+        return 0;
+}
+
+static void test_setup(Test *test) {
+        int r;
+
+        *test = (Test){};
+
+        r = b1_interface_new(&test->interface, "org.bus1.Test");
+        assert(r >= 0);
+        r = b1_interface_add_member(test->interface, "Call", "(tu)", "()", test_member_fn);
+        assert(r >= 0);
+
+        r = b1_peer_new(&test->peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(test->peer, &test->node, &test->handle);
+        assert(r >= 0);
+        test->clone = b1_node_get_peer(test->node);
+
+        r = b1_node_implement(test->node, test->interface);
+        assert(r >= 0);
+
+        r = b1_node_new(test->peer, &test->passed, NULL);
+        assert(r >= 0);
+}
+
+static void test_teardown(Test *test) {
+        b1_reply_slot_free(test->slot);
+        b1_handle_unref(test->received);
+        b1_node_free(test->passed);
+        b1_handle_unref(test->handle);
+        b1_node_free(test->node);
+        b1_peer_unref(test->peer);
+        b1_interface_unref(test->interface);
+}
+
+static void test_op_call(Test *test) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        int r;
+
+        r = b1_message_new_call(test->peer, &message, "org.bus1.Test", "Call", "(tu)", "()",
+                                &test->slot, test_reply_fn, test);
+        assert(r >= 0);
+        r = b1_message_write(message, "(tu)", UINT64_C(1), UINT32_C(2));
+        assert(r >= 0);
+        r = b1_message_send(message, &test->handle, 1);
+        assert(r >= 0);
+}
+
+static void test_op_dispatch(Test *test) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        int r;
+
+        r = b1_peer_recv(test->clone, &message);
+        assert(r >= 0);
+        r = b1_message_dispatch(message);
+        assert(r >= 0);
+}
+
+static void test_op_reply(Test *test) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        int r;
+
+        test->done = false;
+
+        r = b1_peer_recv(test->peer, &message);
+        assert(r >= 0);
+        r = b1_message_dispatch(message);
+        assert(r >= 0);
+        assert(test->done);
+
+        test->slot = b1_reply_slot_free(test->slot);
+}
+
+static void test_op_handle(Test *test) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL, *received = NULL;
+        B1Handle *handle;
+        int r;
+
+        r = b1_message_new_call(test->peer, &message, "org.bus1.Test", "Pass", "()", "()",
+                                NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_append_handle(message, b1_node_get_handle(test->passed));
+        assert(r >= 0);
+        r = b1_message_send(message, &test->handle, 1);
+        assert(r >= 0);
+
+        r = b1_peer_recv(test->clone, &received);
+        assert(r >= 0);
+        r = b1_message_get_handle(received, 0, &handle);
+        assert(r >= 0);
+
+        /* keep the first one, so passing it again finds the known handle */
+        if (!test->received)
+                test->received = b1_handle_ref(handle);
+        assert(test->received == handle);
+}
+
+static void test_budget(Test *test,
+                        const char *name,
+                        void (*op) (Test *test),
+                        uint64_t budget,
+                        TestCount *count) {
+        test_count_begin(count);
+        op(test);
+        test_count_end(count);
+
+        fprintf(stderr, "%-10s allocs:%" PRIu64 " frees:%" PRIu64 " budget:%" PRIu64 "\n",
+                name, count->n_allocs, count->n_frees, budget);
+        assert(count->n_allocs <= budget);
+}
+
+static void test_roundtrip(Test *test, bool check) {
+        TestCount call, dispatch, reply;
+
+        if (!check) {
+                test_op_call(test);
+                test_op_dispatch(test);
+                test_op_reply(test);
+                return;
+        }
+
+        test_budget(test, "call", test_op_call, TEST_BUDGET_CALL, &call);
+        test_budget(test, "dispatch", test_op_dispatch, TEST_BUDGET_DISPATCH, &dispatch);
+        test_budget(test, "reply", test_op_reply, TEST_BUDGET_REPLY, &reply);
+
+        /* a completed round-trip must not leave anything behind */
+        assert(call.n_allocs + dispatch.n_allocs + reply.n_allocs ==
+               call.n_frees + dispatch.n_frees + reply.n_frees);
+}
+
+static void test_handle(Test *test, bool check) {
+        TestCount handle;
+
+        if (!check) {
+                test_op_handle(test);
+                return;
+        }
+
+        test_budget(test, "handle", test_op_handle, TEST_BUDGET_HANDLE, &handle);
+        assert(handle.n_allocs == handle.n_frees);
+}
+
+int main(int argc, char **argv) {
+        Test test;
+
+        if (access("/dev/bus1", F_OK) < 0 && errno == ENOENT)
+                return 77;
+
+        test_setup(&test);
+
+        for (unsigned int i = 0; i < TEST_WARMUP + TEST_RUNS; ++i) {
+                test_roundtrip(&test, i >= TEST_WARMUP);
+                test_handle(&test, i >= TEST_WARMUP);
+        }
+
+        test_teardown(&test);
+
+        return 0;
+}
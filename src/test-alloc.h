@@ -0,0 +1,71 @@
+#pragma once
+
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Allocation Counter
+ *
+ * This interposes the malloc() family and counts all allocations done by the
+ * process, including the ones of libbus1 and its dependencies. It relies on
+ * glibc exporting its allocator as __libc_*() and must be included by exactly
+ * one translation unit of a test program.
+ *
+ * Only allocations are counted; realloc() counts as an allocation, as it may
+ * move the memory. Counters are updated atomically, so they can be sampled
+ * from any thread.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n_members, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static uint64_t test_alloc_n_allocs;
+static uint64_t test_alloc_n_frees;
+
+void *malloc(size_t size) {
+        __atomic_add_fetch(&test_alloc_n_allocs, 1, __ATOMIC_RELAXED);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t n_members, size_t size) {
+        __atomic_add_fetch(&test_alloc_n_allocs, 1, __ATOMIC_RELAXED);
+        return __libc_calloc(n_members, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+        __atomic_add_fetch(&test_alloc_n_allocs, 1, __ATOMIC_RELAXED);
+        return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+        if (ptr)
+                __atomic_add_fetch(&test_alloc_n_frees, 1, __ATOMIC_RELAXED);
+        __libc_free(ptr);
+}
+
+static inline uint64_t test_alloc_get_allocs(void) {
+        return __atomic_load_n(&test_alloc_n_allocs, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t test_alloc_get_frees(void) {
+        return __atomic_load_n(&test_alloc_n_frees, __ATOMIC_RELAXED);
+}
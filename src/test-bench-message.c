@@ -0,0 +1,357 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Marshalling Microbenchmark
+ *
+ * This isolates the serialization costs of the library from the kernel. The
+ * peer used here is never connected to /dev/bus1: it only serves as owner of
+ * messages and reply slots, none of which ever get a kernel id. Received
+ * messages are created from an in-memory copy of a sealed message, the same
+ * way b1_peer_recv() creates them from the pool.
+ *
+ * Every case runs a setup step, the measured operation and a teardown step.
+ * Only the operation is timed and accounted, the overhead of the clock itself
+ * is measured once and subtracted. For each case, one line is printed with the
+ * time and the number of allocations and frees per operation.
+ */
+
+#undef NDEBUG
+#include <c-macro.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "message.h"
+#include "org.bus1/b1-peer.h"
+#include "peer.h"
+#include "test-alloc.h"
+
+typedef struct BenchShape {
+        const char *signature;
+} BenchShape;
+
+typedef struct Bench {
+        B1Peer *peer;
+        const BenchShape *shape;
+        B1Message *message;
+        B1ReplySlot *slot;
+        void *slice;
+        size_t n_slice;
+} Bench;
+
+typedef struct BenchCase {
+        const char *name;
+        bool per_shape;
+        void (*setup) (Bench *bench);
+        void (*op) (Bench *bench);
+        void (*teardown) (Bench *bench);
+} BenchCase;
+
+static const BenchShape bench_shapes[] = {
+        { "(tu)" },
+        { "(ss)" },
+        { "a(tu)" },
+};
+
+static const char bench_string[] = "org.bus1.Bench.String.0123456789";
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static int bench_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+        return 0;
+}
+
+static void bench_new_call(Bench *bench, const char *signature, B1ReplySlot **slotp) {
+        int r;
+
+        r = b1_message_new_call(bench->peer, &bench->message, "org.bus1.Bench", "Member",
+                                signature, "()", slotp, bench_reply_fn, NULL);
+        assert(r >= 0);
+}
+
+static void bench_write(Bench *bench) {
+        int r;
+
+        if (!strcmp(bench->shape->signature, "(tu)")) {
+                r = b1_message_write(bench->message, "(tu)", UINT64_C(7), UINT32_C(7));
+                assert(r >= 0);
+        } else if (!strcmp(bench->shape->signature, "(ss)")) {
+                r = b1_message_write(bench->message, "(ss)", bench_string, bench_string);
+                assert(r >= 0);
+        } else {
+                r = b1_message_begin(bench->message, "a");
+                assert(r >= 0);
+                for (unsigned int i = 0; i < 16; ++i) {
+                        r = b1_message_write(bench->message, "(tu)", (uint64_t)i, (uint32_t)i);
+                        assert(r >= 0);
+                }
+                r = b1_message_end(bench->message, "a");
+                assert(r >= 0);
+        }
+}
+
+static void bench_read(Bench *bench) {
+        const char *s1, *s2;
+        uint64_t t;
+        uint32_t u;
+        int r;
+
+        if (!strcmp(bench->shape->signature, "(tu)")) {
+                r = b1_message_read(bench->message, "(tu)", &t, &u);
+                assert(r >= 0);
+        } else if (!strcmp(bench->shape->signature, "(ss)")) {
+                r = b1_message_read(bench->message, "(ss)", &s1, &s2);
+                assert(r >= 0);
+        } else {
+                r = b1_message_enter(bench->message, "a");
+                assert(r >= 0);
+                while (b1_message_peek_count(bench->message) > 0) {
+                        r = b1_message_read(bench->message, "(tu)", &t, &u);
+                        assert(r >= 0);
+                }
+                r = b1_message_exit(bench->message, "a");
+                assert(r >= 0);
+        }
+}
+
+/* serialize a call of the current shape into a buffer, to serve as slice */
+static void bench_prepare_slice(Bench *bench) {
+        const struct iovec *vecs;
+        size_t n_vecs;
+        int r;
+
+        free(bench->slice);
+
+        bench_new_call(bench, bench->shape->signature, NULL);
+        bench_write(bench);
+        r = b1_message_seal(bench->message);
+        assert(r >= 0);
+
+        vecs = c_variant_get_vecs(bench->message->data.cv, &n_vecs);
+        bench->n_slice = 0;
+        for (size_t i = 0; i < n_vecs; ++i)
+                bench->n_slice += vecs[i].iov_len;
+
+        bench->slice = malloc(c_align_to(bench->n_slice, 8));
+        assert(bench->slice);
+
+        bench->n_slice = 0;
+        for (size_t i = 0; i < n_vecs; ++i) {
+                memcpy((uint8_t *)bench->slice + bench->n_slice, vecs[i].iov_base, vecs[i].iov_len);
+                bench->n_slice += vecs[i].iov_len;
+        }
+
+        bench->message = b1_message_unref(bench->message);
+}
+
+static void bench_from_slice(Bench *bench) {
+        int r;
+
+        r = b1_message_new_from_slice(&bench->message, bench->peer, bench->slice, bench->n_slice);
+        assert(r >= 0);
+}
+
+static void bench_parse(Bench *bench) {
+        int r;
+
+        r = b1_message_parse_header(bench->message);
+        assert(r >= 0);
+}
+
+static void bench_noop(Bench *bench) {
+}
+
+static void bench_release(Bench *bench) {
+        /* the slice is not part of a pool, so it must not be released */
+        if (bench->message && bench->message->data.slice)
+                bench->message->data.slice = NULL;
+
+        bench->message = b1_message_unref(bench->message);
+        bench->slot = b1_reply_slot_free(bench->slot);
+}
+
+static void bench_op_call(Bench *bench) {
+        bench_new_call(bench, "(tu)", NULL);
+}
+
+static void bench_op_call_slot(Bench *bench) {
+        bench_new_call(bench, "(tu)", &bench->slot);
+}
+
+static void bench_op_reply(Bench *bench) {
+        int r;
+
+        r = b1_message_new_reply(bench->peer, &bench->message, "(tu)", "", NULL, NULL, NULL);
+        assert(r >= 0);
+}
+
+static void bench_op_error(Bench *bench) {
+        int r;
+
+        r = b1_message_new_error(bench->peer, &bench->message, "org.bus1.Error.Bench", "()");
+        assert(r >= 0);
+}
+
+static void bench_setup_write(Bench *bench) {
+        bench_new_call(bench, bench->shape->signature, NULL);
+}
+
+static void bench_setup_seal(Bench *bench) {
+        bench_new_call(bench, bench->shape->signature, NULL);
+        bench_write(bench);
+}
+
+static void bench_op_seal(Bench *bench) {
+        int r;
+
+        r = b1_message_seal(bench->message);
+        assert(r >= 0);
+}
+
+static void bench_op_recv(Bench *bench) {
+        bench_from_slice(bench);
+        bench_parse(bench);
+}
+
+static void bench_setup_read(Bench *bench) {
+        bench_from_slice(bench);
+        bench_parse(bench);
+}
+
+static void bench_setup_rewind(Bench *bench) {
+        bench_setup_read(bench);
+        bench_read(bench);
+}
+
+static void bench_op_rewind(Bench *bench) {
+        b1_message_rewind(bench->message);
+}
+
+static const BenchCase bench_cases[] = {
+        { "new_call", false, bench_noop, bench_op_call, bench_release },
+        { "new_call_slot", false, bench_noop, bench_op_call_slot, bench_release },
+        { "new_reply", false, bench_noop, bench_op_reply, bench_release },
+        { "new_error", false, bench_noop, bench_op_error, bench_release },
+        { "write", true, bench_setup_write, bench_write, bench_release },
+        { "seal", true, bench_setup_seal, bench_op_seal, bench_release },
+        { "from_slice", true, bench_noop, bench_from_slice, bench_release },
+        { "parse_header", true, bench_from_slice, bench_parse, bench_release },
+        { "recv", true, bench_noop, bench_op_recv, bench_release },
+        { "read", true, bench_setup_read, bench_read, bench_release },
+        { "rewind", true, bench_setup_rewind, bench_op_rewind, bench_release },
+};
+
+static uint64_t bench_overhead(unsigned int n_iterations) {
+        uint64_t start, total = 0;
+
+        for (unsigned int i = 0; i < n_iterations; ++i) {
+                start = bench_now();
+                total += bench_now() - start;
+        }
+
+        return total / n_iterations;
+}
+
+static void bench_run(Bench *bench, const BenchCase *c, unsigned int n_iterations, uint64_t overhead) {
+        uint64_t start, nsec = 0, n_allocs = 0, n_frees = 0, allocs, frees;
+        char name[128];
+
+        for (unsigned int i = 0; i < n_iterations; ++i) {
+                c->setup(bench);
+
+                allocs = test_alloc_get_allocs();
+                frees = test_alloc_get_frees();
+                start = bench_now();
+
+                c->op(bench);
+
+                nsec += bench_now() - start;
+                n_allocs += test_alloc_get_allocs() - allocs;
+                n_frees += test_alloc_get_frees() - frees;
+
+                c->teardown(bench);
+        }
+
+        nsec /= n_iterations;
+
+        snprintf(name, sizeof(name), "%s%s%s",
+                 c->name,
+                 c->per_shape ? ":" : "",
+                 c->per_shape ? bench->shape->signature : "");
+
+        printf("%-24s %10" PRIu64 " %8.2f %8.2f\n",
+               name,
+               nsec > overhead ? nsec - overhead : 0,
+               (double)n_allocs / n_iterations,
+               (double)n_frees / n_iterations);
+}
+
+int main(int argc, char **argv) {
+        Bench bench = {};
+        unsigned int n_iterations = 100000;
+        const char *filter = NULL;
+        uint64_t overhead;
+
+        if (argc > 3) {
+                fprintf(stderr, "Usage: %s [#iterations] [filter]\n", program_invocation_short_name);
+                return 77;
+        }
+
+        if (argc > 1)
+                n_iterations = strtoul(argv[1], NULL, 10) ?: n_iterations;
+        if (argc > 2)
+                filter = argv[2];
+
+        /* a detached peer, which owns messages but never talks to the kernel */
+        bench.peer = calloc(1, sizeof(*bench.peer));
+        assert(bench.peer);
+        bench.peer->n_ref = 1;
+
+        overhead = bench_overhead(n_iterations);
+
+        printf("# case ns_per_op allocs_per_op frees_per_op\n");
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(bench_cases); ++i) {
+                const BenchCase *c = &bench_cases[i];
+
+                if (filter && !strstr(c->name, filter))
+                        continue;
+
+                if (!c->per_shape) {
+                        bench.shape = &bench_shapes[0];
+                        bench_run(&bench, c, n_iterations, overhead);
+                        continue;
+                }
+
+                for (size_t j = 0; j < C_ARRAY_SIZE(bench_shapes); ++j) {
+                        bench.shape = &bench_shapes[j];
+                        bench_prepare_slice(&bench);
+                        bench_run(&bench, c, n_iterations, overhead);
+                }
+        }
+
+        free(bench.slice);
+        b1_peer_unref(bench.peer);
+
+        return 0;
+}
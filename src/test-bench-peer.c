@@ -0,0 +1,369 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Peer Benchmark
+ *
+ * This measures the full library path between two peers: message
+ * construction, b1_message_send(), b1_peer_recv() and b1_message_dispatch().
+ * Both peers are driven from a single thread, so the numbers contain library
+ * and kernel costs, but no scheduler wakeups.
+ *
+ * Two modes are run for a matrix of payload signatures, sizes, and handle/fd
+ * counts:
+ *
+ *   roundtrip:  a call is sent, dispatched by the server which replies, and
+ *               the reply is dispatched by the client. Latency percentiles of
+ *               the whole cycle are reported.
+ *   oneway:     calls without reply slots are sent in batches and received
+ *               and dispatched by the server. Throughput is reported.
+ *
+ * Results are printed to stdout as whitespace separated columns, one line per
+ * run, preceded by a header line starting with '#'.
+ */
+
+#undef NDEBUG
+#include <c-macro.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "org.bus1/b1-peer.h"
+
+#define BENCH_BATCH_MAX (64)
+#define BENCH_PAYLOAD_MAX (256 * 1024)
+
+typedef struct Bench {
+        B1Peer *client;
+        B1Peer *server;
+        B1Node *node;
+        B1Handle *handle;
+        B1Interface *interface;
+        B1Node *nodes[16];
+        int null_fd;
+        uint64_t n_replies;
+} Bench;
+
+typedef struct BenchShape {
+        const char *member;
+        const char *signature;
+        size_t sizes[8]; /* zero-terminated */
+} BenchShape;
+
+static const BenchShape bench_shapes[] = {
+        { "Bytes", "ay", { 8, 64, 512, 4096, 32768, 262144 } },
+        { "Fixed", "(tu)", { 16 } },
+        { "Strings", "(ss)", { 8, 64, 512, 4096 } },
+        { "Array", "a(tu)", { 16, 256, 4096, 65536 } },
+};
+
+static uint8_t bench_payload[BENCH_PAYLOAD_MAX];
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+        uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int bench_member_fn(B1Node *node, void *userdata, B1Message *message) {
+        _c_cleanup_(b1_message_unrefp) B1Message *reply = NULL;
+        int r;
+
+        if (!b1_message_get_reply_handle(message))
+                return 0;
+
+        r = b1_message_new_reply(b1_node_get_peer(node), &reply, "", "", NULL, NULL, NULL);
+        assert(r >= 0);
+
+        r = b1_message_reply(message, reply);
+        assert(r >= 0);
+
+        return 0;
+}
+
+static int bench_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+        Bench *bench = userdata;
+
+        assert(b1_message_get_type(message) == B1_MESSAGE_TYPE_REPLY);
+        ++bench->n_replies;
+
+        return 0;
+}
+
+static void bench_write(B1Message *message, const BenchShape *shape, size_t size) {
+        struct iovec vec = { .iov_base = bench_payload, .iov_len = size };
+        char *str;
+        int r;
+
+        if (!strcmp(shape->signature, "ay")) {
+                r = b1_message_insert(message, "ay", &vec, 1);
+                assert(r >= 0);
+        } else if (!strcmp(shape->signature, "(tu)")) {
+                r = b1_message_write(message, "(tu)", UINT64_C(1), UINT32_C(2));
+                assert(r >= 0);
+        } else if (!strcmp(shape->signature, "(ss)")) {
+                str = alloca(size / 2 + 1);
+                memset(str, 'x', size / 2);
+                str[size / 2] = 0;
+                r = b1_message_write(message, "(ss)", str, str);
+                assert(r >= 0);
+        } else if (!strcmp(shape->signature, "a(tu)")) {
+                r = b1_message_begin(message, "a");
+                assert(r >= 0);
+                for (size_t i = 0; i < size / 16; ++i) {
+                        r = b1_message_write(message, "(tu)", (uint64_t)i, (uint32_t)i);
+                        assert(r >= 0);
+                }
+                r = b1_message_end(message, "a");
+                assert(r >= 0);
+        } else {
+                assert(0);
+        }
+}
+
+static void bench_send(Bench *bench,
+                       const BenchShape *shape,
+                       size_t size,
+                       unsigned int n_handles,
+                       unsigned int n_fds,
+                       bool reply) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
+        int r;
+
+        r = b1_message_new_call(bench->client, &message,
+                                "org.bus1.Bench", shape->member,
+                                shape->signature, "()",
+                                reply ? &slot : NULL, bench_reply_fn, bench);
+        assert(r >= 0);
+
+        for (unsigned int i = 0; i < n_handles; ++i) {
+                r = b1_message_append_handle(message, b1_node_get_handle(bench->nodes[i]));
+                assert(r >= 0);
+        }
+
+        for (unsigned int i = 0; i < n_fds; ++i) {
+                r = b1_message_append_fd(message, bench->null_fd);
+                assert(r >= 0);
+        }
+
+        bench_write(message, shape, size);
+
+        r = b1_message_send(message, &bench->handle, 1);
+        assert(r >= 0);
+
+        if (reply) {
+                uint64_t n_replies = bench->n_replies;
+
+                /* the slot must outlive the reply, so complete the cycle here */
+                while (bench->n_replies == n_replies) {
+                        _c_cleanup_(b1_message_unrefp) B1Message *m = NULL;
+
+                        r = b1_peer_recv(bench->server, &m);
+                        if (r >= 0) {
+                                r = b1_message_dispatch(m);
+                                assert(r >= 0);
+                                continue;
+                        }
+                        assert(r == -EAGAIN);
+
+                        r = b1_peer_recv(bench->client, &m);
+                        assert(r >= 0);
+                        r = b1_message_dispatch(m);
+                        assert(r >= 0);
+                }
+        }
+}
+
+static void bench_drain(Bench *bench, unsigned int n) {
+        int r;
+
+        for (unsigned int i = 0; i < n; ++i) {
+                _c_cleanup_(b1_message_unrefp) B1Message *m = NULL;
+
+                r = b1_peer_recv(bench->server, &m);
+                assert(r >= 0);
+                r = b1_message_dispatch(m);
+                assert(r >= 0);
+        }
+}
+
+static void bench_roundtrip(Bench *bench,
+                            const BenchShape *shape,
+                            size_t size,
+                            unsigned int n_handles,
+                            unsigned int n_fds,
+                            uint64_t times) {
+        uint64_t *samples, start, total = 0;
+
+        samples = calloc(times, sizeof(*samples));
+        assert(samples);
+
+        /* warm up caches and allocate handles; don't account them */
+        for (uint64_t i = 0; i < times / 10 + 1; ++i)
+                bench_send(bench, shape, size, n_handles, n_fds, true);
+
+        for (uint64_t i = 0; i < times; ++i) {
+                start = bench_now();
+                bench_send(bench, shape, size, n_handles, n_fds, true);
+                samples[i] = bench_now() - start;
+                total += samples[i];
+        }
+
+        qsort(samples, times, sizeof(*samples), bench_cmp_u64);
+
+        printf("roundtrip %-5s %7zu %2u %2u %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12.0f %10.2f\n",
+               shape->signature, size, n_handles, n_fds, times,
+               total / times,
+               samples[times / 2],
+               samples[times * 99 / 100],
+               samples[times * 999 / 1000],
+               times * 1e9 / total,
+               (double)size * times * 1e9 / total / (1024 * 1024));
+
+        free(samples);
+}
+
+static void bench_oneway(Bench *bench,
+                         const BenchShape *shape,
+                         size_t size,
+                         unsigned int n_handles,
+                         unsigned int n_fds,
+                         uint64_t times) {
+        uint64_t start, total, i = 0;
+        unsigned int n, batch;
+
+        /* keep the batch well within the receiver pool */
+        batch = c_max(c_min((size_t)BENCH_BATCH_MAX, (8 * 1024 * 1024) / (size + 256)), (size_t)1);
+
+        start = bench_now();
+        while (i < times) {
+                n = c_min((uint64_t)batch, times - i);
+                for (unsigned int j = 0; j < n; ++j)
+                        bench_send(bench, shape, size, n_handles, n_fds, false);
+                bench_drain(bench, n);
+                i += n;
+        }
+        total = bench_now() - start;
+
+        printf("oneway    %-5s %7zu %2u %2u %8" PRIu64 " %10" PRIu64 " %10s %10s %10s %12.0f %10.2f\n",
+               shape->signature, size, n_handles, n_fds, times,
+               total / times, "-", "-", "-",
+               times * 1e9 / total,
+               (double)size * times * 1e9 / total / (1024 * 1024));
+}
+
+static void bench_init(Bench *bench) {
+        int r;
+
+        *bench = (Bench){};
+
+        r = b1_interface_new(&bench->interface, "org.bus1.Bench");
+        assert(r >= 0);
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(bench_shapes); ++i) {
+                r = b1_interface_add_member(bench->interface,
+                                            bench_shapes[i].member,
+                                            bench_shapes[i].signature,
+                                            "()",
+                                            bench_member_fn);
+                assert(r >= 0);
+        }
+
+        r = b1_peer_new(&bench->client, NULL);
+        assert(r >= 0);
+
+        r = b1_peer_clone(bench->client, &bench->node, &bench->handle);
+        assert(r >= 0);
+        bench->server = b1_node_get_peer(bench->node);
+
+        r = b1_node_implement(bench->node, bench->interface);
+        assert(r >= 0);
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(bench->nodes); ++i) {
+                r = b1_node_new(bench->client, &bench->nodes[i], NULL);
+                assert(r >= 0);
+        }
+
+        bench->null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+        assert(bench->null_fd >= 0);
+}
+
+static void bench_deinit(Bench *bench) {
+        close(bench->null_fd);
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(bench->nodes); ++i)
+                b1_node_free(bench->nodes[i]);
+
+        b1_handle_unref(bench->handle);
+        b1_node_free(bench->node);
+        b1_peer_unref(bench->client);
+        b1_interface_unref(bench->interface);
+}
+
+int main(int argc, char **argv) {
+        static const unsigned int counts[] = { 1, 4, 16 };
+        Bench bench;
+        uint64_t times = 10UL * 1000UL;
+
+        if (argc > 2) {
+                fprintf(stderr, "Usage: %s [#iterations]\n", program_invocation_short_name);
+                return 77;
+        }
+
+        if (argc == 2)
+                times = strtoull(argv[1], NULL, 10) ?: times;
+
+        if (access("/dev/bus1", F_OK) < 0 && errno == ENOENT)
+                return 77;
+
+        bench_init(&bench);
+
+        printf("# mode signature size handles fds n avg_ns p50_ns p99_ns p999_ns msgs_per_sec mib_per_sec\n");
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(bench_shapes); ++i) {
+                const BenchShape *shape = &bench_shapes[i];
+
+                for (size_t j = 0; j < C_ARRAY_SIZE(shape->sizes) && shape->sizes[j]; ++j) {
+                        fprintf(stderr, "Run: %s size:%zu\n", shape->signature, shape->sizes[j]);
+                        bench_roundtrip(&bench, shape, shape->sizes[j], 0, 0, times);
+                        bench_oneway(&bench, shape, shape->sizes[j], 0, 0, times);
+                }
+        }
+
+        /* handle and fd passing on top of a small payload */
+        for (size_t i = 0; i < C_ARRAY_SIZE(counts); ++i) {
+                fprintf(stderr, "Run: handles:%u fds:%u\n", counts[i], counts[i]);
+                bench_roundtrip(&bench, &bench_shapes[0], 64, counts[i], 0, times);
+                bench_roundtrip(&bench, &bench_shapes[0], 64, 0, counts[i], times);
+                bench_oneway(&bench, &bench_shapes[0], 64, counts[i], 0, times);
+                bench_oneway(&bench, &bench_shapes[0], 64, 0, counts[i], times);
+        }
+
+        bench_deinit(&bench);
+
+        return 0;
+}
@@ -0,0 +1,573 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Scalability Benchmark
+ *
+ * This builds topologies of peers via b1_peer_clone() and measures how the
+ * library scales with the number of peers and threads:
+ *
+ *   fan-in:    N clients call a single server in a closed loop, each with one
+ *              call in flight.
+ *   fan-out:   a publisher multicasts messages to N subscribers.
+ *   chain:     a client calls a server through a chain of N proxies, each of
+ *              which forwards the call and relays the reply back.
+ *
+ * The number of peers is doubled from 1 up to the given maximum. Peers are
+ * distributed round-robin over the given number of worker threads, each of
+ * which polls its peers and dispatches their messages. B1Peer objects are not
+ * thread-safe, so every peer is only ever touched by a single thread once the
+ * topology is set up.
+ *
+ * For each step, one line is printed to stdout with the aggregate message rate
+ * and latency statistics across all samples, as well as the worst average
+ * latency of any single peer.
+ */
+
+#undef NDEBUG
+#include <c-macro.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "org.bus1/b1-peer.h"
+
+#define BENCH_WINDOW (32)
+
+typedef struct Worker {
+        pthread_t thread;
+        B1Peer **peers;
+        size_t n_peers;
+        bool stop;
+} Worker;
+
+typedef struct Endpoint {
+        B1Peer *peer;           /* the peer itself */
+        B1Node *node;           /* its root node */
+        B1Handle *handle;       /* handle of the root peer to @node */
+        B1Handle *next;         /* handle of @peer to the next hop, if any */
+        const char *member;     /* member to call, if this is a client */
+        B1ReplySlot *slot;
+        uint64_t sent_at;
+        uint64_t n_done;
+        uint64_t *samples;
+        uint64_t n_samples;
+} Endpoint;
+
+typedef struct Bench {
+        B1Peer *root;
+        B1Interface *interface;
+        Endpoint *endpoints;
+        size_t n_endpoints;
+        Worker *workers;
+        size_t n_workers;
+        uint64_t n_messages;
+} Bench;
+
+/*
+ * Root nodes of cloned peers carry the peer as userdata, so member handlers
+ * look up their endpoint by peer. Topologies are small and set up before any
+ * worker runs, so a linear search over the read-only array is sufficient.
+ */
+static Bench *bench_current;
+
+static Endpoint *bench_endpoint(B1Peer *peer) {
+        for (size_t i = 0; i < bench_current->n_endpoints; ++i)
+                if (bench_current->endpoints[i].peer == peer)
+                        return &bench_current->endpoints[i];
+
+        assert(0);
+        return NULL;
+}
+
+static uint64_t bench_now(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static int bench_cmp_u64(const void *a, const void *b) {
+        uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void bench_recv_all(B1Peer *peer) {
+        int r;
+
+        for (;;) {
+                _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+
+                r = b1_peer_recv(peer, &message);
+                if (r == -EAGAIN)
+                        return;
+                assert(r >= 0);
+
+                r = b1_message_dispatch(message);
+                assert(r >= 0);
+        }
+}
+
+static void bench_poll(B1Peer **peers, size_t n_peers, int timeout) {
+        struct pollfd fds[n_peers];
+        int r;
+
+        for (size_t i = 0; i < n_peers; ++i)
+                fds[i] = (struct pollfd){ .fd = b1_peer_get_fd(peers[i]), .events = POLLIN };
+
+        r = poll(fds, n_peers, timeout);
+        assert(r >= 0 || errno == EINTR);
+
+        for (size_t i = 0; r > 0 && i < n_peers; ++i)
+                if (fds[i].revents & POLLIN)
+                        bench_recv_all(peers[i]);
+}
+
+static void *bench_worker_fn(void *userdata) {
+        Worker *worker = userdata;
+
+        while (!__atomic_load_n(&worker->stop, __ATOMIC_ACQUIRE))
+                bench_poll(worker->peers, worker->n_peers, 10);
+
+        return NULL;
+}
+
+static void bench_workers_start(Bench *bench, B1Peer **peers, size_t n_peers, size_t n_threads) {
+        int r;
+
+        bench->n_workers = c_max(c_min(n_threads, n_peers), (size_t)1);
+        bench->workers = calloc(bench->n_workers, sizeof(*bench->workers));
+        assert(bench->workers);
+
+        for (size_t i = 0; i < bench->n_workers; ++i) {
+                bench->workers[i].peers = calloc(n_peers, sizeof(B1Peer *));
+                assert(bench->workers[i].peers);
+        }
+
+        for (size_t i = 0; i < n_peers; ++i) {
+                Worker *worker = &bench->workers[i % bench->n_workers];
+
+                worker->peers[worker->n_peers++] = peers[i];
+        }
+
+        for (size_t i = 0; i < bench->n_workers; ++i) {
+                r = pthread_create(&bench->workers[i].thread, NULL, bench_worker_fn, &bench->workers[i]);
+                assert(r == 0);
+        }
+}
+
+static void bench_workers_stop(Bench *bench) {
+        for (size_t i = 0; i < bench->n_workers; ++i)
+                __atomic_store_n(&bench->workers[i].stop, true, __ATOMIC_RELEASE);
+
+        for (size_t i = 0; i < bench->n_workers; ++i) {
+                pthread_join(bench->workers[i].thread, NULL);
+                free(bench->workers[i].peers);
+        }
+
+        free(bench->workers);
+        bench->workers = NULL;
+        bench->n_workers = 0;
+}
+
+/*
+ * Pass a handle of the root peer to @to, so @to ends up with its own handle
+ * to the same node.
+ */
+static void bench_pass_handle(Bench *bench, Endpoint *to, B1Handle *handle, B1Handle **handlep) {
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL, *received = NULL;
+        B1Handle *h;
+        int r;
+
+        r = b1_message_new_call(bench->root, &message, "org.bus1.Setup", "Handle", "()", "", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_append_handle(message, handle);
+        assert(r == 0);
+        r = b1_message_send(message, &to->handle, 1);
+        assert(r >= 0);
+
+        r = b1_peer_recv(to->peer, &received);
+        assert(r >= 0);
+        r = b1_message_get_handle(received, 0, &h);
+        assert(r >= 0);
+
+        *handlep = b1_handle_ref(h);
+}
+
+static int bench_ping_fn(B1Node *node, void *userdata, B1Message *message) {
+        _c_cleanup_(b1_message_unrefp) B1Message *reply = NULL;
+        int r;
+
+        r = b1_message_new_reply(b1_node_get_peer(node), &reply, "", "", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_reply(message, reply);
+        assert(r >= 0);
+
+        return 0;
+}
+
+static int bench_publish_fn(B1Node *node, void *userdata, B1Message *message) {
+        Endpoint *e = bench_endpoint(b1_node_get_peer(node));
+        uint64_t sent_at;
+        int r;
+
+        r = b1_message_read(message, "(t)", &sent_at);
+        assert(r >= 0);
+
+        if (e->n_done < e->n_samples)
+                e->samples[e->n_done] = bench_now() - sent_at;
+        __atomic_store_n(&e->n_done, e->n_done + 1, __ATOMIC_RELEASE);
+
+        return 0;
+}
+
+static int bench_proxy_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+        _c_cleanup_(b1_message_unrefp) B1Message *origin = userdata, *reply = NULL;
+        int r;
+
+        r = b1_message_new_reply(b1_handle_get_peer(b1_message_get_reply_handle(origin)), &reply, "", "", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_reply(origin, reply);
+        assert(r >= 0);
+
+        b1_reply_slot_free(slot);
+
+        return 0;
+}
+
+static int bench_proxy_fn(B1Node *node, void *userdata, B1Message *message) {
+        _c_cleanup_(b1_message_unrefp) B1Message *call = NULL;
+        Endpoint *e = bench_endpoint(b1_node_get_peer(node));
+        B1ReplySlot *slot;
+        int r;
+
+        r = b1_message_new_call(b1_node_get_peer(node), &call, "org.bus1.Bench", e->member, "(t)", "()",
+                                &slot, bench_proxy_reply_fn, b1_message_ref(message));
+        assert(r >= 0);
+        r = b1_message_write(call, "(t)", UINT64_C(0));
+        assert(r >= 0);
+        r = b1_message_send(call, &e->next, 1);
+        assert(r >= 0);
+
+        return 0;
+}
+
+static void bench_client_call(Endpoint *e);
+
+static int bench_client_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+        Endpoint *e = userdata;
+
+        if (e->n_done < e->n_samples)
+                e->samples[e->n_done] = bench_now() - e->sent_at;
+
+        b1_reply_slot_free(slot);
+        e->slot = NULL;
+
+        __atomic_store_n(&e->n_done, e->n_done + 1, __ATOMIC_RELEASE);
+        if (e->n_done < e->n_samples)
+                bench_client_call(e);
+
+        return 0;
+}
+
+/* issue the next call of a client, which keeps exactly one call in flight */
+static void bench_client_call(Endpoint *e) {
+        _c_cleanup_(b1_message_unrefp) B1Message *call = NULL;
+        int r;
+
+        r = b1_message_new_call(e->peer, &call, "org.bus1.Bench", e->member, "(t)", "()",
+                                &e->slot, bench_client_reply_fn, e);
+        assert(r >= 0);
+        r = b1_message_write(call, "(t)", UINT64_C(0));
+        assert(r >= 0);
+
+        e->sent_at = bench_now();
+        r = b1_message_send(call, &e->next, 1);
+        assert(r >= 0);
+}
+
+static void bench_wait(Endpoint *endpoints, size_t n_endpoints, uint64_t n_messages) {
+        for (size_t i = 0; i < n_endpoints; ++i)
+                while (__atomic_load_n(&endpoints[i].n_done, __ATOMIC_ACQUIRE) < n_messages)
+                        sched_yield();
+}
+
+static void bench_setup(Bench *bench, size_t n_endpoints, uint64_t n_messages) {
+        int r;
+
+        *bench = (Bench){};
+        bench_current = bench;
+
+        r = b1_interface_new(&bench->interface, "org.bus1.Bench");
+        assert(r >= 0);
+        r = b1_interface_add_member(bench->interface, "Ping", "(t)", "()", bench_ping_fn);
+        assert(r >= 0);
+        r = b1_interface_add_member(bench->interface, "Publish", "(t)", "()", bench_publish_fn);
+        assert(r >= 0);
+        r = b1_interface_add_member(bench->interface, "Proxy", "(t)", "()", bench_proxy_fn);
+        assert(r >= 0);
+
+        r = b1_peer_new(&bench->root, NULL);
+        assert(r >= 0);
+
+        bench->n_messages = n_messages;
+        bench->n_endpoints = n_endpoints;
+        bench->endpoints = calloc(n_endpoints, sizeof(*bench->endpoints));
+        assert(bench->endpoints);
+
+        for (size_t i = 0; i < n_endpoints; ++i) {
+                Endpoint *e = &bench->endpoints[i];
+
+                r = b1_peer_clone(bench->root, &e->node, &e->handle);
+                assert(r >= 0);
+                e->peer = b1_node_get_peer(e->node);
+
+                r = b1_node_implement(e->node, bench->interface);
+                assert(r >= 0);
+
+                e->n_samples = n_messages;
+                e->samples = calloc(n_messages, sizeof(*e->samples));
+                assert(e->samples);
+        }
+}
+
+static void bench_teardown(Bench *bench) {
+        for (size_t i = 0; i < bench->n_endpoints; ++i) {
+                Endpoint *e = &bench->endpoints[i];
+
+                b1_reply_slot_free(e->slot);
+                b1_handle_unref(e->next);
+                b1_handle_unref(e->handle);
+                b1_node_free(e->node);
+                free(e->samples);
+        }
+
+        free(bench->endpoints);
+        b1_peer_unref(bench->root);
+        b1_interface_unref(bench->interface);
+}
+
+static void bench_report(const char *mode, size_t n_peers, size_t n_threads,
+                         Endpoint *endpoints, size_t n_endpoints,
+                         uint64_t n_msgs, uint64_t nsec) {
+        uint64_t *all, n_all = 0, worst = 0, total = 0;
+
+        for (size_t i = 0; i < n_endpoints; ++i)
+                n_all += c_min(endpoints[i].n_done, endpoints[i].n_samples);
+
+        all = calloc(n_all + 1, sizeof(*all));
+        assert(all);
+
+        n_all = 0;
+        for (size_t i = 0; i < n_endpoints; ++i) {
+                Endpoint *e = &endpoints[i];
+                uint64_t n = c_min(e->n_done, e->n_samples), sum = 0;
+
+                for (uint64_t j = 0; j < n; ++j) {
+                        all[n_all++] = e->samples[j];
+                        sum += e->samples[j];
+                }
+
+                total += sum;
+                if (n)
+                        worst = c_max(worst, sum / n);
+        }
+
+        qsort(all, n_all, sizeof(*all), bench_cmp_u64);
+
+        printf("%-7s %5zu %3zu %9" PRIu64 " %12.0f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+               mode, n_peers, n_threads, n_msgs,
+               n_msgs * 1e9 / nsec,
+               n_all ? total / n_all : 0,
+               all[n_all / 2],
+               all[n_all * 99 / 100],
+               worst);
+
+        free(all);
+}
+
+static void bench_fan_in(size_t n_clients, size_t n_threads, uint64_t n_messages) {
+        Bench bench;
+        Endpoint *server;
+        B1Peer **peers;
+        uint64_t start, end;
+
+        /* endpoint 0 is the server, all others are clients */
+        bench_setup(&bench, n_clients + 1, n_messages);
+        server = &bench.endpoints[0];
+        server->n_samples = 0;
+
+        peers = calloc(n_clients + 1, sizeof(*peers));
+        assert(peers);
+        peers[0] = server->peer;
+        for (size_t i = 1; i <= n_clients; ++i) {
+                bench_pass_handle(&bench, &bench.endpoints[i], server->handle, &bench.endpoints[i].next);
+                bench.endpoints[i].member = "Ping";
+                peers[i] = bench.endpoints[i].peer;
+        }
+
+        /* the first calls are issued before any worker owns the clients */
+        start = bench_now();
+        for (size_t i = 1; i <= n_clients; ++i)
+                bench_client_call(&bench.endpoints[i]);
+
+        bench_workers_start(&bench, peers, n_clients + 1, n_threads);
+        bench_wait(bench.endpoints + 1, n_clients, n_messages);
+        end = bench_now();
+        bench_workers_stop(&bench);
+
+        bench_report("fan-in", n_clients, n_threads, bench.endpoints + 1, n_clients,
+                     n_clients * n_messages, end - start);
+
+        free(peers);
+        bench_teardown(&bench);
+}
+
+static void bench_fan_out(size_t n_subscribers, size_t n_threads, uint64_t n_messages) {
+        Bench bench;
+        B1Handle **handles;
+        B1Peer **subscribers;
+        uint64_t start, end, lowest;
+        int r;
+
+        bench_setup(&bench, n_subscribers, n_messages);
+
+        handles = calloc(n_subscribers, sizeof(*handles));
+        subscribers = calloc(n_subscribers, sizeof(*subscribers));
+        assert(handles && subscribers);
+        for (size_t i = 0; i < n_subscribers; ++i) {
+                handles[i] = bench.endpoints[i].handle;
+                subscribers[i] = bench.endpoints[i].peer;
+        }
+
+        bench_workers_start(&bench, subscribers, n_subscribers, n_threads);
+
+        start = bench_now();
+        for (uint64_t m = 0; m < n_messages; ++m) {
+                _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+
+                /* keep at most BENCH_WINDOW messages queued per subscriber */
+                for (;;) {
+                        lowest = UINT64_MAX;
+                        for (size_t i = 0; i < n_subscribers; ++i)
+                                lowest = c_min(lowest, __atomic_load_n(&bench.endpoints[i].n_done, __ATOMIC_ACQUIRE));
+                        if (lowest + BENCH_WINDOW >= m)
+                                break;
+                        sched_yield();
+                }
+
+                r = b1_message_new_call(bench.root, &message, "org.bus1.Bench", "Publish", "(t)", "()", NULL, NULL, NULL);
+                assert(r >= 0);
+                r = b1_message_write(message, "(t)", bench_now());
+                assert(r >= 0);
+                r = b1_message_send(message, handles, n_subscribers);
+                assert(r >= 0);
+        }
+
+        bench_wait(bench.endpoints, n_subscribers, n_messages);
+        end = bench_now();
+        bench_workers_stop(&bench);
+
+        bench_report("fan-out", n_subscribers, n_threads, bench.endpoints, n_subscribers,
+                     n_messages * n_subscribers, end - start);
+
+        free(subscribers);
+        free(handles);
+        bench_teardown(&bench);
+}
+
+static void bench_chain(size_t n_proxies, size_t n_threads, uint64_t n_messages) {
+        Bench bench;
+        Endpoint *client;
+        B1Peer **hops;
+        uint64_t start, end;
+
+        /* endpoint 0 is the client, followed by the proxies and the server */
+        bench_setup(&bench, n_proxies + 2, n_messages);
+        client = &bench.endpoints[0];
+
+        hops = calloc(n_proxies + 1, sizeof(*hops));
+        assert(hops);
+        for (size_t i = 0; i <= n_proxies; ++i) {
+                bench_pass_handle(&bench, &bench.endpoints[i], bench.endpoints[i + 1].handle, &bench.endpoints[i].next);
+                bench.endpoints[i].member = (i < n_proxies) ? "Proxy" : "Ping";
+                hops[i] = bench.endpoints[i + 1].peer;
+        }
+
+        bench_workers_start(&bench, hops, n_proxies + 1, n_threads);
+
+        /* the client is driven from this thread, with one call in flight */
+        start = bench_now();
+        bench_client_call(client);
+        while (client->n_done < n_messages)
+                bench_poll(&client->peer, 1, -1);
+        end = bench_now();
+
+        bench_workers_stop(&bench);
+
+        bench_report("chain", n_proxies, n_threads, client, 1, n_messages, end - start);
+
+        free(hops);
+        bench_teardown(&bench);
+}
+
+int main(int argc, char **argv) {
+        void (*fn) (size_t n_peers, size_t n_threads, uint64_t n_messages);
+        size_t max_peers = 64, n_threads = 1;
+        uint64_t n_messages = 1000;
+
+        if (argc < 2 || argc > 5) {
+                fprintf(stderr, "Usage: %s <fan-in|fan-out|chain> [#max-peers] [#threads] [#messages]\n",
+                        program_invocation_short_name);
+                return 77;
+        }
+
+        if (!strcmp(argv[1], "fan-in")) {
+                fn = bench_fan_in;
+        } else if (!strcmp(argv[1], "fan-out")) {
+                fn = bench_fan_out;
+        } else if (!strcmp(argv[1], "chain")) {
+                fn = bench_chain;
+        } else {
+                fprintf(stderr, "Invalid topology: %s\n", argv[1]);
+                return 77;
+        }
+
+        if (argc > 2)
+                max_peers = strtoul(argv[2], NULL, 10) ?: max_peers;
+        if (argc > 3)
+                n_threads = strtoul(argv[3], NULL, 10) ?: n_threads;
+        if (argc > 4)
+                n_messages = strtoull(argv[4], NULL, 10) ?: n_messages;
+
+        if (access("/dev/bus1", F_OK) < 0 && errno == ENOENT)
+                return 77;
+
+        printf("# topology peers threads msgs msgs_per_sec avg_ns p50_ns p99_ns worst_peer_avg_ns\n");
+
+        for (size_t n = 1; n <= max_peers; n <<= 1) {
+                fprintf(stderr, "Run: %s peers:%zu threads:%zu\n", argv[1], n, n_threads);
+                fn(n, n_threads, n_messages);
+        }
+
+        return 0;
+}
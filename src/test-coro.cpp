@@ -0,0 +1,103 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * C++ Coroutines Test
+ *
+ * A peer calls one of its own nodes from several tasks concurrently, each
+ * awaiting a sequence of calls, all driven by a single executor.
+ */
+
+#undef NDEBUG
+#include <cassert>
+#include <cerrno>
+#include <unistd.h>
+#include "org.bus1/b1-coro.hpp"
+
+using Input = std::tuple<uint64_t, uint64_t>;
+using Output = std::tuple<uint64_t>;
+
+static unsigned int n_done;
+
+static int test_add_fn(B1Node *node, void *userdata, B1Message *request) {
+        b1::Message message(b1_message_ref(request)), reply;
+        Input input;
+        int r;
+
+        r = message.read(input);
+        assert(r >= 0);
+
+        r = b1::Message::new_reply<Output>(b1_node_get_peer(node), reply);
+        assert(r >= 0);
+        r = reply.write(Output{ std::get<0>(input) + std::get<1>(input) });
+        assert(r >= 0);
+
+        return message.reply(reply);
+}
+
+static b1::Task test_task(b1::Executor &executor, B1Handle *handle, uint64_t start) {
+        uint64_t value = start;
+
+        for (unsigned int i = 0; i < 4; ++i) {
+                auto reply = co_await executor.call<Output>(handle, "org.bus1.Coro", "Add", value, uint64_t(1));
+
+                assert(reply.error == 0);
+                value = std::get<0>(reply.value);
+        }
+
+        auto reply = co_await executor.call<Output>(handle, "org.bus1.Coro", "Missing", value);
+        assert(reply.error == -EREMOTEIO);
+
+        assert(value == start + 4);
+        ++n_done;
+}
+
+int main(int argc, char **argv) {
+        b1::Peer peer;
+        b1::Node node;
+        b1::Interface interface;
+        int r;
+
+        if (access("/dev/bus1", F_OK) < 0 && errno == ENOENT)
+                return 77;
+
+        r = b1::Interface::create(interface, "org.bus1.Coro");
+        assert(r >= 0);
+        r = interface.add_member<Input, Output>("Add", test_add_fn);
+        assert(r >= 0);
+
+        r = b1::Peer::create(peer);
+        assert(r >= 0);
+        r = b1::Node::create(peer.get(), node);
+        assert(r >= 0);
+        r = node.implement(interface);
+        assert(r >= 0);
+
+        {
+                b1::Executor executor(peer.get());
+
+                for (uint64_t i = 0; i < 16; ++i)
+                        executor.spawn(test_task(executor, node.handle(), i * 100));
+
+                r = executor.run();
+                assert(r >= 0);
+        }
+
+        assert(n_done == 16);
+
+        return 0;
+}
@@ -0,0 +1,129 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * C++ Bindings Test
+ *
+ * Signatures are verified at compile time. If /dev/bus1 is available, a call
+ * is sent and answered through the wrappers.
+ */
+
+#undef NDEBUG
+#include <cassert>
+#include <cerrno>
+#include <unistd.h>
+#include "org.bus1/b1-peer.hpp"
+
+static_assert(std::string_view(b1::signature_v<uint64_t>.c_str()) == "t");
+static_assert(std::string_view(b1::signature_v<std::tuple<>>.c_str()) == "()");
+static_assert(std::string_view(b1::signature_v<std::tuple<uint64_t, uint32_t>>.c_str()) == "(tu)");
+static_assert(std::string_view(b1::signature_v<std::vector<std::tuple<std::string, bool>>>.c_str()) == "a(sb)");
+static_assert(!std::is_copy_constructible_v<b1::Message>);
+static_assert(std::is_nothrow_move_constructible_v<b1::Message>);
+
+using Input = std::tuple<uint64_t, std::string_view, std::vector<uint32_t>>;
+using Output = std::tuple<uint64_t>;
+
+static bool done;
+
+static int test_member_fn(B1Node *node, void *userdata, B1Message *request) {
+        b1::Message message(b1_message_ref(request)), reply;
+        Input input;
+        int r;
+
+        r = message.read(input);
+        assert(r >= 0);
+        assert(std::get<0>(input) == 7);
+        assert(std::get<1>(input) == "foo");
+        assert(std::get<2>(input).size() == 3);
+
+        r = b1::Message::new_reply<Output>(b1_node_get_peer(node), reply);
+        assert(r >= 0);
+        r = reply.write(Output{ std::get<0>(input) * 6 });
+        assert(r >= 0);
+
+        return message.reply(reply);
+}
+
+static int test_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *reply) {
+        b1::Message message(b1_message_ref(reply));
+        Output output;
+        int r;
+
+        r = message.read(output);
+        assert(r >= 0);
+        assert(std::get<0>(output) == 42);
+
+        done = true;
+
+        return 0;
+}
+
+static void test_call(void) {
+        b1::Peer peer;
+        b1::Node node;
+        b1::Handle handle;
+        b1::Interface interface;
+        b1::Message call, request, reply;
+        B1Peer *clone;
+        B1ReplySlot *slot = nullptr;
+        int r;
+
+        r = b1::Interface::create(interface, "org.bus1.Cxx");
+        assert(r >= 0);
+        r = interface.add_member<Input, Output>("Call", test_member_fn);
+        assert(r >= 0);
+
+        r = b1::Peer::create(peer);
+        assert(r >= 0);
+        r = peer.clone(node, handle);
+        assert(r >= 0);
+        clone = node.peer();
+
+        r = node.implement(interface);
+        assert(r >= 0);
+
+        r = b1::Message::new_call<Input, Output>(peer.get(), call, "org.bus1.Cxx", "Call",
+                                                 &slot, test_reply_fn, nullptr);
+        assert(r >= 0);
+        r = call.write(Input{ 7, "foo", { 1, 2, 3 } });
+        assert(r >= 0);
+        r = call.send(handle);
+        assert(r >= 0);
+
+        r = b1_peer_recv(clone, request.out());
+        assert(r >= 0);
+        r = request.dispatch();
+        assert(r >= 0);
+
+        r = peer.recv(reply);
+        assert(r >= 0);
+        r = reply.dispatch();
+        assert(r >= 0);
+        assert(done);
+
+        b1_reply_slot_free(slot);
+}
+
+int main(int argc, char **argv) {
+        if (access("/dev/bus1", F_OK) < 0 && errno == ENOENT)
+                return 77;
+
+        test_call();
+
+        return 0;
+}
@@ -27,7 +27,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <c-variant.h>
+#include "bus1-client.h"
+#include "linux/bus1.h"
+#include "message.h"
+#include "node.h"
 #include "org.bus1/b1-peer.h"
+#include "peer.h"
 
 static bool done = false;
 
@@ -76,6 +81,21 @@ static int slot_function(B1ReplySlot *slot, void *userdata, B1Message *message)
         return 0;
 }
 
+static unsigned int hook_counts[_B1_HOOK_N];
+
+static void *hook_begin(B1Peer *peer, void *userdata, unsigned int event, B1Message *message)
+{
+        return &hook_counts[event];
+}
+
+static void hook_end(B1Peer *peer, void *userdata, unsigned int event, B1Message *message, void *context, int result)
+{
+        assert(context == &hook_counts[event]);
+        assert(result >= 0);
+
+        ++hook_counts[event];
+}
+
 static void test_cvariant(void)
 {
         _c_cleanup_(c_variant_freep) CVariant *cv = NULL, *cv2;
@@ -148,6 +168,10 @@ static void test_api(void)
         _c_cleanup_(b1_node_freep) B1Node *node = NULL;
         _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
         _c_cleanup_(b1_message_unrefp) B1Message *message = NULL, *request = NULL, *reply = NULL;
+        B1PoolStats stats;
+        B1MemberStats member_stats;
+        B1Record records[4];
+        size_t n_records;
         uint64_t num1 = 0;
         uint32_t num2 = 0;
         int r;
@@ -190,12 +214,44 @@ static void test_api(void)
         r = b1_message_send(message, &handle, 1);
         assert(r >= 0);
 
+        r = b1_peer_set_recorder(clone, 3);
+        assert(r >= 0);
+        b1_peer_set_hooks(clone, &(B1PeerHooks){ hook_begin, hook_end }, NULL);
         r = b1_peer_recv(clone, &request);
         assert(r >= 0);
         assert(request);
+        assert(b1_message_get_type(request) == B1_MESSAGE_TYPE_CALL);
+        b1_peer_get_pool_stats(clone, &stats);
+        assert(stats.n_slices == 1);
+        assert(stats.n_bytes > 0);
+        assert(stats.n_bytes == stats.n_bytes_max);
+        b1_peer_set_dispatch_stats(clone, true);
         r = b1_message_dispatch(request);
         assert(r >= 0);
 
+        r = b1_interface_get_stats(interface, "bar", &member_stats);
+        assert(r >= 0);
+        assert(member_stats.handler.n_samples == 1);
+        assert(member_stats.queue.n_samples == 1);
+        assert(b1_histogram_get_percentile(&member_stats.handler, 50) <= member_stats.handler.max_nsec);
+        assert(b1_interface_get_stats(interface, "baz", &member_stats) == -ENOENT);
+        b1_interface_reset_stats(interface);
+        r = b1_interface_get_stats(interface, NULL, &member_stats);
+        assert(r >= 0);
+        assert(member_stats.handler.n_samples == 0);
+
+        n_records = b1_peer_get_records(clone, records, C_ARRAY_SIZE(records));
+        assert(n_records >= 2);
+        assert(records[0].kind == B1_RECORD_RECV);
+        assert(records[n_records - 1].kind == B1_RECORD_DISPATCH);
+        assert(!strcmp(records[n_records - 1].interface, "foo"));
+        assert(!strcmp(records[n_records - 1].member, "bar"));
+
+        b1_peer_set_hooks(clone, NULL, NULL);
+        assert(hook_counts[B1_HOOK_RECV] == 1);
+        assert(hook_counts[B1_HOOK_DISPATCH] == 1);
+        assert(hook_counts[B1_HOOK_SEND] == 1);
+
         r = b1_peer_recv(peer, &reply);
         assert(r >= 0);
         assert(reply);
@@ -205,6 +261,515 @@ static void test_api(void)
         assert(done);
 }
 
+static void test_send_time(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL;
+        B1Message *request;
+        int r;
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+
+        r = b1_message_new_call(peer, &message, "foo", "bar", "(tu)", "()", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_write(message, "(tu)", 1, 2);
+        assert(r >= 0);
+
+        r = b1_message_send(message, &handle, 1);
+        assert(r >= 0);
+        r = b1_peer_recv(b1_node_get_peer(node), &request);
+        assert(r >= 0);
+        assert(b1_message_get_send_time(request) == 0);
+        assert(b1_message_get_queue_delay(request) == 0);
+        b1_message_unref(request);
+
+        /* the same sealed message can be sent stamped */
+        b1_peer_set_send_timestamps(peer, true);
+        r = b1_message_send(message, &handle, 1);
+        assert(r >= 0);
+        r = b1_peer_recv(b1_node_get_peer(node), &request);
+        assert(r >= 0);
+        assert(b1_message_get_send_time(request) > 0);
+        assert(b1_message_get_queue_delay(request) < UINT64_C(10000000000));
+        b1_message_unref(request);
+}
+
+static unsigned int n_errors;
+
+static int error_function(B1ReplySlot *slot, void *userdata, B1Message *message)
+{
+        assert(b1_message_get_type(message) == B1_MESSAGE_TYPE_ERROR);
+        ++n_errors;
+
+        return 0;
+}
+
+static void test_errors(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_interface_unrefp) B1Interface *interface = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot1 = NULL, *slot2 = NULL;
+        B1ReplySlot **slots[] = { &slot1, &slot2 };
+        B1Peer *clone;
+        int r;
+
+        r = b1_interface_new(&interface, "foo");
+        assert(r >= 0);
+        r = b1_interface_add_member(interface, "bar", "(tu)", "()", node_function);
+        assert(r >= 0);
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        clone = b1_node_get_peer(node);
+        r = b1_node_implement(node, interface);
+        assert(r >= 0);
+
+        /* both calls are answered with the same cached error reply */
+        for (size_t i = 0; i < C_ARRAY_SIZE(slots); ++i) {
+                _c_cleanup_(b1_message_unrefp) B1Message *call = NULL, *request = NULL;
+
+                r = b1_message_new_call(peer, &call, "foo", "baz", "()", "()", slots[i], error_function, NULL);
+                assert(r >= 0);
+                r = b1_message_send(call, &handle, 1);
+                assert(r >= 0);
+
+                r = b1_peer_recv(clone, &request);
+                assert(r >= 0);
+                r = b1_message_dispatch(request);
+                assert(r >= 0);
+        }
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(slots); ++i) {
+                _c_cleanup_(b1_message_unrefp) B1Message *error = NULL;
+
+                r = b1_peer_recv(peer, &error);
+                assert(r >= 0);
+                r = b1_message_dispatch(error);
+                assert(r >= 0);
+        }
+
+        assert(n_errors == 2);
+}
+
+static B1Message *retained;
+
+static void *retain_begin(B1Peer *peer, void *userdata, unsigned int event, B1Message *message)
+{
+        if (event == B1_HOOK_SEND && !retained)
+                retained = b1_message_ref(message);
+
+        return NULL;
+}
+
+static void test_errors_retained(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *call = NULL, *request = NULL;
+        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
+        B1Node *node;
+        B1Peer *clone;
+        int r;
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        clone = b1_node_get_peer(node);
+        b1_peer_set_hooks(clone, &(B1PeerHooks){ retain_begin, NULL }, NULL);
+
+        /* the node implements nothing, so this is answered from the cache */
+        r = b1_message_new_call(peer, &call, "foo", "bar", "()", "()", &slot, error_function, NULL);
+        assert(r >= 0);
+        r = b1_message_send(call, &handle, 1);
+        assert(r >= 0);
+        r = b1_peer_recv(clone, &request);
+        assert(r >= 0);
+        r = b1_message_dispatch(request);
+        assert(r >= 0);
+        request = b1_message_unref(request);
+        assert(retained);
+
+        /* the cached reply outlives the cache, and keeps its peer alive */
+        b1_node_free(node);
+        assert(b1_message_get_type(retained) == B1_MESSAGE_TYPE_ERROR);
+        retained = b1_message_unref(retained);
+}
+
+static void test_coalesce(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL, *request = NULL;
+        uint64_t value;
+        int r;
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        b1_peer_set_coalesce_threshold(peer, 4096);
+
+        /* more inserted pieces than the kernel accepts vectors */
+        r = b1_message_new_call(peer, &message, "foo", "bar", "at", "()", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_begin(message, "a");
+        assert(r >= 0);
+        for (value = 0; value < 600; ++value) {
+                r = b1_message_insert(message, "t", &(struct iovec){ &value, sizeof(value) }, 1);
+                assert(r >= 0);
+        }
+        r = b1_message_end(message, "a");
+        assert(r >= 0);
+
+        r = b1_message_send(message, &handle, 1);
+        assert(r >= 0);
+        assert(b1_peer_get_coalesced_bytes(peer) > 0);
+
+        r = b1_peer_recv(b1_node_get_peer(node), &request);
+        assert(r >= 0);
+        r = b1_message_enter(request, "a");
+        assert(r >= 0);
+        for (uint64_t i = 0; i < 600; ++i) {
+                r = b1_message_read(request, "t", &value);
+                assert(r >= 0);
+                assert(value == i);
+        }
+}
+
+static void release_function(void *userdata)
+{
+        ++*(unsigned int *)userdata;
+}
+
+static void test_attach(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *request = NULL;
+        B1Message *message;
+        char head[] = "head", tail[8192];
+        struct iovec vecs[] = {
+                { head, sizeof(head) },
+                { tail, sizeof(tail) },
+        };
+        unsigned int n_released = 0;
+        const uint8_t *data;
+        size_t n_bytes;
+        uint32_t value;
+        int r;
+
+        memset(tail, 'x', sizeof(tail));
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        b1_peer_set_send_timestamps(peer, true);
+
+        r = b1_message_new_call(peer, &message, "foo", "bar", "u", "()", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_write(message, "u", 7);
+        assert(r >= 0);
+        r = b1_message_attach(message, vecs, 2, release_function, &n_released);
+        assert(r >= 0);
+        r = b1_message_attach(message, vecs, 2, release_function, &n_released);
+        assert(r == -EEXIST);
+
+        r = b1_message_send(message, &handle, 1);
+        assert(r >= 0);
+        r = b1_message_attach(message, vecs, 2, NULL, NULL);
+        assert(r == -EBUSY);
+        assert(n_released == 0);
+        message = b1_message_unref(message);
+        assert(n_released == 1);
+
+        r = b1_peer_recv(b1_node_get_peer(node), &request);
+        assert(r >= 0);
+        assert(b1_message_get_send_time(request) > 0);
+        r = b1_message_read(request, "u", &value);
+        assert(r >= 0);
+        assert(value == 7);
+
+        data = b1_message_get_attachment(request, &n_bytes);
+        assert(data);
+        assert(n_bytes == sizeof(head) + sizeof(tail));
+        assert(!memcmp(data, head, sizeof(head)));
+        assert(!memcmp(data + sizeof(head), tail, sizeof(tail)));
+}
+
+static void test_cursor(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_signature_unrefp) B1Signature *signature = NULL;
+        _c_cleanup_(b1_signature_unrefp) B1Signature *multi = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *message = NULL, *request = NULL;
+        B1Cursor root, array, record;
+        const struct {
+                uint64_t t;
+                uint32_t u;
+        } *value;
+        const char *string;
+        size_t n_bytes;
+        int r;
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        r = b1_signature_new(&signature, "(a(tu)as)");
+        assert(r >= 0);
+
+        r = b1_message_new_call(peer, &message, "foo", "bar", "(a(tu)as)", "()", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_begin(message, "(a");
+        assert(r >= 0);
+        for (uint64_t i = 0; i < 1000; ++i) {
+                r = b1_message_write(message, "(tu)", i, (uint32_t)i * 2);
+                assert(r >= 0);
+        }
+        r = b1_message_end(message, "a");
+        assert(r >= 0);
+        r = b1_message_begin(message, "a");
+        assert(r >= 0);
+        r = b1_message_write(message, "s", "foo");
+        assert(r >= 0);
+        r = b1_message_write(message, "s", "bar");
+        assert(r >= 0);
+        r = b1_message_end(message, "a)");
+        assert(r >= 0);
+
+        r = b1_message_send(message, &handle, 1);
+        assert(r >= 0);
+        r = b1_peer_recv(b1_node_get_peer(node), &request);
+        assert(r >= 0);
+
+        r = b1_signature_new(&multi, "us");
+        assert(r >= 0);
+        r = b1_message_open_cursor(request, multi, &root);
+        assert(r == -EINVAL);
+
+        r = b1_message_open_cursor(request, signature, &root);
+        assert(r >= 0);
+        r = b1_cursor_enter(&root, &record);
+        assert(r >= 0);
+        r = b1_cursor_enter(&record, &array);
+        assert(r >= 0);
+        assert(b1_cursor_get_count(&array) == 1000);
+
+        for (uint64_t i = 0; (value = b1_cursor_next(&array, &n_bytes)); ++i) {
+                assert(n_bytes == sizeof(*value));
+                assert(value->t == i);
+                assert(value->u == i * 2);
+        }
+        assert(b1_cursor_get_count(&array) == 0);
+
+        r = b1_cursor_enter(&record, &array);
+        assert(r >= 0);
+        r = b1_cursor_skip(&array, 1);
+        assert(r >= 0);
+        string = b1_cursor_next(&array, &n_bytes);
+        assert(string && n_bytes == 4 && !strcmp(string, "bar"));
+        assert(!b1_cursor_next(&array, NULL));
+}
+
+/* send @data as is, bypassing the serialization of the library */
+static void send_raw(B1Peer *peer, B1Handle *handle, const void *data, size_t n_data)
+{
+        uint64_t destination = handle->id;
+        struct iovec vec = { (void *)data, n_data };
+        struct bus1_cmd_send send = {
+                .ptr_destinations = (uintptr_t)&destination,
+                .n_destinations = 1,
+                .ptr_vecs = (uintptr_t)&vec,
+                .n_vecs = 1,
+        };
+        int r;
+
+        r = bus1_client_send(peer->client, &send);
+        assert(r >= 0);
+}
+
+static void test_malformed(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        B1Message *message;
+        B1PoolStats stats;
+        uint64_t data[4];
+        uint8_t bytes[64];
+        int r;
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+
+        /* the trailer claims an envelope larger than the message */
+        data[0] = B1_MESSAGE_TYPE_CALL | B1_MESSAGE_FLAG_ATTACHMENT;
+        data[1] = 0;
+        data[2] = 64;
+        data[3] = 0;
+        send_raw(peer, handle, data, sizeof(data));
+
+        r = b1_peer_recv(b1_node_get_peer(node), &message);
+        assert(r == -EBADMSG);
+        b1_peer_get_pool_stats(b1_node_get_peer(node), &stats);
+        assert(stats.n_slices == 0);
+        assert(stats.n_bytes == 0);
+
+        /* the sizes in the trailer only add up modulo 2^64 */
+        memset(bytes, 0, sizeof(bytes));
+        data[0] = B1_MESSAGE_TYPE_CALL | B1_MESSAGE_FLAG_ATTACHMENT;
+        data[1] = 17;
+        data[2] = UINT64_MAX - 6;
+        memcpy(bytes, &data[0], sizeof(data[0]));
+        memcpy(bytes + 17, &data[1], 2 * sizeof(data[1]));
+        send_raw(peer, handle, bytes, 17 + 2 * sizeof(uint64_t));
+
+        r = b1_peer_recv(b1_node_get_peer(node), &message);
+        assert(r == -EBADMSG);
+        b1_peer_get_pool_stats(b1_node_get_peer(node), &stats);
+        assert(stats.n_slices == 0);
+
+        r = b1_peer_recv(b1_node_get_peer(node), &message);
+        assert(r == -EAGAIN);
+}
+
+static void test_credits(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        B1Peer *clone = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_interface_unrefp) B1Interface *interface = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot1 = NULL, *slot2 = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *call1 = NULL, *call2 = NULL, *call3 = NULL;
+        B1Message *message;
+        uint64_t n_bytes, n_messages, t;
+        uint32_t u;
+        int r;
+
+        r = b1_interface_new(&interface, "foo");
+        assert(r >= 0);
+        r = b1_interface_add_member(interface, "bar", "(tu)", "()", node_function);
+        assert(r >= 0);
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        clone = b1_node_get_peer(node);
+        r = b1_node_implement(node, interface);
+        assert(r >= 0);
+
+        r = b1_handle_set_credits(handle, B1_CREDIT_POLICY_QUEUE, 4096, 1);
+        assert(r >= 0);
+
+        r = b1_message_new_call(peer, &call1, "foo", "bar", "(tu)", "()", &slot1, slot_function, NULL);
+        assert(r >= 0);
+        r = b1_message_write(call1, "(tu)", 1, 2);
+        assert(r >= 0);
+        r = b1_message_new_call(peer, &call2, "foo", "bar", "(tu)", "()", &slot2, slot_function, NULL);
+        assert(r >= 0);
+        r = b1_message_write(call2, "(tu)", 1, 2);
+        assert(r >= 0);
+
+        /* the second call is queued until the first one is answered */
+        r = b1_message_send(call1, &handle, 1);
+        assert(r >= 0);
+        r = b1_message_send(call2, &handle, 1);
+        assert(r >= 0);
+        b1_handle_get_credits(handle, &n_bytes, &n_messages);
+        assert(n_messages == 0);
+        assert(n_bytes < 4096);
+
+        /* a message that expects no reply must not overtake queued ones */
+        r = b1_message_new_call(peer, &call3, "foo", "bar", "(tu)", "()", NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_write(call3, "(tu)", 3, 4);
+        assert(r >= 0);
+        r = b1_message_send(call3, &handle, 1);
+        assert(r >= 0);
+
+        r = b1_peer_recv(clone, &message);
+        assert(r >= 0);
+        r = b1_message_dispatch(message);
+        assert(r >= 0);
+        b1_message_unref(message);
+        r = b1_peer_recv(clone, &message);
+        assert(r == -EAGAIN);
+
+        /* dispatching the reply returns the credits and flushes the queue */
+        r = b1_peer_recv(peer, &message);
+        assert(r >= 0);
+        r = b1_message_dispatch(message);
+        assert(r >= 0);
+        b1_message_unref(message);
+        b1_handle_get_credits(handle, NULL, &n_messages);
+        assert(n_messages == 0);
+
+        r = b1_peer_recv(clone, &message);
+        assert(r >= 0);
+        r = b1_message_read(message, "(tu)", &t, &u);
+        assert(r >= 0);
+        assert(t == 1 && u == 2);
+        b1_message_unref(message);
+        r = b1_peer_recv(clone, &message);
+        assert(r >= 0);
+        r = b1_message_read(message, "(tu)", &t, &u);
+        assert(r >= 0);
+        assert(t == 3 && u == 4);
+        b1_message_unref(message);
+
+        /* without queueing, exhausted credits are reported to the caller */
+        r = b1_handle_set_credits(handle, B1_CREDIT_POLICY_REJECT, 4096, 0);
+        assert(r >= 0);
+        r = b1_message_send(call1, &handle, 1);
+        assert(r == -EAGAIN);
+}
+
+static void test_pool(void)
+{
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        B1IoctlStats ioctl_stats;
+        B1PoolStats stats;
+        int r;
+
+        r = b1_peer_new_with_pool(&peer, NULL, 1024 * 1024, B1_POOL_FLAG_PREFAULT);
+        assert(r >= 0);
+        b1_peer_get_pool_stats(peer, &stats);
+        assert(stats.pool_size == 1024 * 1024);
+
+        /* nothing was received, so auto-sizing picks the minimum */
+        assert(b1_peer_get_pool_size_hint(peer) == B1_POOL_SIZE_MIN);
+        r = b1_peer_set_ioctl_stats(peer, true);
+        assert(r >= 0);
+        r = b1_peer_clone_with_pool(peer, &node, &handle, 0, B1_POOL_FLAG_AUTO_SIZE);
+        assert(r >= 0);
+        b1_peer_get_ioctl_stats(peer, &ioctl_stats);
+        assert(ioctl_stats.cmds[B1_IOCTL_PEER_CLONE].n_calls == 1);
+        assert(ioctl_stats.cmds[B1_IOCTL_PEER_CLONE].n_errors == 0);
+        b1_peer_get_pool_stats(b1_node_get_peer(node), &stats);
+        assert(stats.pool_size == B1_POOL_SIZE_MIN);
+}
+
 static void test_seed(void) {
         _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
         _c_cleanup_(b1_message_unrefp) B1Message *seed = NULL;
@@ -234,6 +799,15 @@ int main(int argc, char **argv) {
 
         test_cvariant();
         test_api();
+        test_send_time();
+        test_errors();
+        test_errors_retained();
+        test_coalesce();
+        test_attach();
+        test_cursor();
+        test_malformed();
+        test_credits();
+        test_pool();
         test_seed();
 
         return 0;
@@ -19,6 +19,12 @@
  * Performance Test
  * XXX: Add description, and rename to something more appropriate
  *      than test-perf.
+ *
+ * Xmitters below C_ARRAY_SIZE(test_xmitters) copy messages into a memfd within
+ * a single thread. All following xmitters are transports, which move messages
+ * from a parent to a forked child process and are measured end to end. For
+ * those, the time column is wall-clock time and an additional column carries
+ * the average round-trip time in nanoseconds.
  */
 
 #undef NDEBUG
@@ -26,15 +32,22 @@
 #include <c-syscall.h>
 #include <c-usec.h>
 #include <fcntl.h>
+#include <linux/futex.h>
 #include <linux/memfd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #define TEST_BUFSIZE (4096LL * 4096LL) /* 4096 pages */
+#define TEST_TRANSPORT_MAX (4096 << 4) /* largest blob sent by test_run_all() */
+#define TEST_RING_SLOTS (16)
 
 typedef struct {
         uint32_t arg1;
@@ -44,6 +57,18 @@ typedef struct {
         uint8_t blob[];
 } TestMessage;
 
+static struct {
+        TestMessage m;
+        uint8_t blob[4096 * 4096];
+} test_args = {
+        .m = {
+                .arg1 = UINT32_C(0xabcdabcd),
+                .arg2 = UINT32_C(0xffffffff),
+                .arg3 = UINT64_C(0xff00ff00ff00ff00),
+        },
+        .blob = {},
+};
+
 static void test_message_write1(int fd, void *map, const TestMessage *args) {
         memcpy(map, args, sizeof(*args) + args->size);
 }
@@ -140,24 +165,321 @@ static void test_message_xmit(int fd, void *map, const TestMessage *args, unsign
 }
 
 static void test_xmit(int fd, void *map, unsigned int xmitter, uint64_t times, uint64_t size) {
-        static struct {
-                TestMessage m;
-                uint8_t blob[4096 * 4096];
-        } m = {
-                .m = {
-                        .arg1 = UINT32_C(0xabcdabcd),
-                        .arg2 = UINT32_C(0xffffffff),
-                        .arg3 = UINT64_C(0xff00ff00ff00ff00),
-                },
-                .blob = {},
+        uint64_t i;
+
+        assert(size <= sizeof(test_args.blob));
+
+        test_args.m.size = size;
+        for (i = 0; i < times; ++i)
+                test_message_xmit(fd, map, &test_args.m, xmitter);
+}
+
+typedef struct {
+        uint32_t head __attribute__((__aligned__(64)));
+        uint32_t head_waiting;
+        uint32_t tail __attribute__((__aligned__(64)));
+        uint32_t tail_waiting;
+        uint8_t slots[TEST_RING_SLOTS][sizeof(TestMessage) + TEST_TRANSPORT_MAX] __attribute__((__aligned__(64)));
+} TestRing;
+
+typedef struct {
+        pid_t child;
+        int fds[2];             /* transport from parent to child */
+        int doorbell[2];        /* parent notifies child */
+        int credit[2];          /* child returns buffer to parent */
+        int ack[2];             /* child acknowledges to parent */
+        uint8_t *buffer;        /* receive buffer, at the same address in both */
+        TestRing *ring;
+} TestChannel;
+
+typedef struct {
+        void (*init) (TestChannel *c);
+        void (*send) (TestChannel *c, const TestMessage *args);
+        const TestMessage *(*recv) (TestChannel *c);
+        void (*release) (TestChannel *c);
+} TestTransport;
+
+static uint64_t test_nsec(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+static void test_write_all(int fd, const void *data, size_t n) {
+        ssize_t r;
+
+        while (n) {
+                r = write(fd, data, n);
+                assert(r > 0);
+                data = (const uint8_t *)data + r;
+                n -= r;
+        }
+}
+
+static void test_read_all(int fd, void *data, size_t n) {
+        ssize_t r;
+
+        while (n) {
+                r = read(fd, data, n);
+                assert(r > 0);
+                data = (uint8_t *)data + r;
+                n -= r;
+        }
+}
+
+static void test_seqpacket_init(TestChannel *c) {
+        int r;
+
+        r = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, c->fds);
+        assert(r >= 0);
+}
+
+static void test_seqpacket_send(TestChannel *c, const TestMessage *args) {
+        ssize_t r;
+
+        r = send(c->fds[0], args, sizeof(*args) + args->size, 0);
+        assert(r >= 0 && (uint64_t)r == sizeof(*args) + args->size);
+}
+
+static const TestMessage *test_seqpacket_recv(TestChannel *c) {
+        const TestMessage *m = (void *)c->buffer;
+        ssize_t r;
+
+        r = recv(c->fds[1], c->buffer, sizeof(*m) + TEST_TRANSPORT_MAX, 0);
+        assert(r >= (ssize_t)sizeof(*m) && (uint64_t)r == sizeof(*m) + m->size);
+
+        return m;
+}
+
+static void test_vmsplice_init(TestChannel *c) {
+        int r;
+
+        r = pipe2(c->fds, O_CLOEXEC);
+        assert(r >= 0);
+
+        /* a single message should fit; ignore failure if the limit is lower */
+        (void)fcntl(c->fds[1], F_SETPIPE_SZ, 1024 * 1024);
+}
+
+static void test_vmsplice_send(TestChannel *c, const TestMessage *args) {
+        struct iovec vec = {
+                .iov_base = (void *)args,
+                .iov_len = sizeof(*args) + args->size,
+        };
+        ssize_t r;
+
+        /* the payload is never modified during a run, so it may be spliced */
+        while (vec.iov_len) {
+                r = vmsplice(c->fds[1], &vec, 1, 0);
+                assert(r > 0);
+                vec.iov_base = (uint8_t *)vec.iov_base + r;
+                vec.iov_len -= r;
+        }
+}
+
+static const TestMessage *test_vmsplice_recv(TestChannel *c) {
+        TestMessage *m = (void *)c->buffer;
+
+        test_read_all(c->fds[0], m, sizeof(*m));
+        assert(m->size <= TEST_TRANSPORT_MAX);
+        test_read_all(c->fds[0], m->blob, m->size);
+
+        return m;
+}
+
+static void test_vm_writev_init(TestChannel *c) {
+        int r;
+
+        r = pipe2(c->doorbell, O_CLOEXEC);
+        assert(r >= 0);
+        r = pipe2(c->credit, O_CLOEXEC);
+        assert(r >= 0);
+}
+
+static void test_vm_writev_send(TestChannel *c, const TestMessage *args) {
+        const struct iovec local = {
+                .iov_base = (void *)args,
+                .iov_len = sizeof(*args) + args->size,
+        };
+        const struct iovec remote = {
+                .iov_base = c->buffer,
+                .iov_len = sizeof(*args) + args->size,
         };
+        ssize_t r;
+        char b = 0;
+
+        /* the child owns a single buffer, so every message is a rendezvous */
+        r = process_vm_writev(c->child, &local, 1, &remote, 1, 0);
+        assert(r >= 0 && (uint64_t)r == sizeof(*args) + args->size);
+
+        test_write_all(c->doorbell[1], &b, 1);
+        test_read_all(c->credit[0], &b, 1);
+}
+
+static const TestMessage *test_vm_writev_recv(TestChannel *c) {
+        char b;
+
+        test_read_all(c->doorbell[0], &b, 1);
+
+        return (void *)c->buffer;
+}
+
+static void test_vm_writev_release(TestChannel *c) {
+        char b = 0;
+
+        test_write_all(c->credit[1], &b, 1);
+}
+
+static void test_ring_wait(uint32_t *word, uint32_t *waiting, uint32_t value) {
+        /* pairs with the exchange in test_ring_wake() */
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == value)
+                (void)syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static void test_ring_wake(uint32_t *word, uint32_t *waiting, uint32_t value) {
+        __atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(waiting, 0, __ATOMIC_SEQ_CST))
+                (void)syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void test_ring_init(TestChannel *c) {
+        c->ring = mmap(NULL, sizeof(*c->ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        assert(c->ring != MAP_FAILED);
+}
+
+static void test_ring_send(TestChannel *c, const TestMessage *args) {
+        TestRing *ring = c->ring;
+        uint32_t head = ring->head, tail;
+
+        while (head - (tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) >= TEST_RING_SLOTS)
+                test_ring_wait(&ring->tail, &ring->tail_waiting, tail);
+
+        memcpy(ring->slots[head % TEST_RING_SLOTS], args, sizeof(*args) + args->size);
+        test_ring_wake(&ring->head, &ring->head_waiting, head + 1);
+}
+
+static const TestMessage *test_ring_recv(TestChannel *c) {
+        TestRing *ring = c->ring;
+        uint32_t tail = ring->tail;
+
+        while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+                test_ring_wait(&ring->head, &ring->head_waiting, tail);
+
+        return (void *)ring->slots[tail % TEST_RING_SLOTS];
+}
+
+static void test_ring_release(TestChannel *c) {
+        TestRing *ring = c->ring;
+
+        test_ring_wake(&ring->tail, &ring->tail_waiting, ring->tail + 1);
+}
+
+static const TestTransport test_transports[] = {
+        { test_seqpacket_init, test_seqpacket_send, test_seqpacket_recv, NULL },
+        { test_vmsplice_init, test_vmsplice_send, test_vmsplice_recv, NULL },
+        { test_vm_writev_init, test_vm_writev_send, test_vm_writev_recv, test_vm_writev_release },
+        { test_ring_init, test_ring_send, test_ring_recv, test_ring_release },
+};
+
+static void test_channel_close(TestChannel *c) {
+        int *fds[] = { c->fds, c->doorbell, c->credit, c->ack };
+
+        for (size_t i = 0; i < C_ARRAY_SIZE(fds); ++i) {
+                if (fds[i][0] >= 0)
+                        close(fds[i][0]);
+                if (fds[i][1] >= 0)
+                        close(fds[i][1]);
+        }
+
+        if (c->ring)
+                munmap(c->ring, sizeof(*c->ring));
+        free(c->buffer);
+}
+
+/*
+ * The child receives a warm-up batch, a measured batch and then single
+ * messages for the round-trip measurement. It acknowledges the end of each
+ * batch and every single message via the ack pipe.
+ */
+static void test_transport_child(TestChannel *c,
+                                 const TestTransport *transport,
+                                 uint64_t n_warmup,
+                                 uint64_t n_batch,
+                                 uint64_t n_rtt) {
+        const TestMessage *m;
         uint64_t i;
+        char b = 0;
+
+        for (i = 0; i < n_warmup + n_batch + n_rtt; ++i) {
+                m = transport->recv(c);
+                test_message_validate(m, &test_args.m);
+                if (transport->release)
+                        transport->release(c);
+
+                if (i + 1 == n_warmup || i + 1 >= n_warmup + n_batch)
+                        test_write_all(c->ack[1], &b, 1);
+        }
+}
+
+static void test_transport_run_one(unsigned int xmitter, uint64_t times, uint64_t size) {
+        const TestTransport *transport = &test_transports[xmitter - C_ARRAY_SIZE(test_xmitters)];
+        TestChannel c = {
+                .fds = { -1, -1 },
+                .doorbell = { -1, -1 },
+                .credit = { -1, -1 },
+                .ack = { -1, -1 },
+        };
+        uint64_t i, n_warmup, n_rtt, start_usec, end_usec, rtt_nsec = 0, start_nsec;
+        int r, status;
+        char b;
+
+        assert(size <= TEST_TRANSPORT_MAX);
 
-        assert(size <= sizeof(m.blob));
+        n_warmup = times / 10 ?: 1;
+        n_rtt = times / 10 ?: 1;
+        test_args.m.size = size;
 
-        m.m.size = size;
+        c.buffer = malloc(sizeof(TestMessage) + TEST_TRANSPORT_MAX);
+        assert(c.buffer);
+        r = pipe2(c.ack, O_CLOEXEC);
+        assert(r >= 0);
+        transport->init(&c);
+
+        c.child = fork();
+        assert(c.child >= 0);
+        if (c.child == 0) {
+                test_transport_child(&c, transport, n_warmup, times, n_rtt);
+                _exit(0);
+        }
+
+        /* do some test runs to initialize caches; don't account them */
+        for (i = 0; i < n_warmup; ++i)
+                transport->send(&c, &test_args.m);
+        test_read_all(c.ack[0], &b, 1);
+
+        /* measure a batch, until the child acknowledged the last message */
+        start_usec = c_usec_from_clock(CLOCK_MONOTONIC);
         for (i = 0; i < times; ++i)
-                test_message_xmit(fd, map, &m.m, xmitter);
+                transport->send(&c, &test_args.m);
+        test_read_all(c.ack[0], &b, 1);
+        end_usec = c_usec_from_clock(CLOCK_MONOTONIC);
+
+        /* measure round-trips of single messages */
+        for (i = 0; i < n_rtt; ++i) {
+                start_nsec = test_nsec();
+                transport->send(&c, &test_args.m);
+                test_read_all(c.ack[0], &b, 1);
+                rtt_nsec += test_nsec() - start_nsec;
+        }
+
+        r = waitpid(c.child, &status, 0);
+        assert(r == c.child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        test_channel_close(&c);
+
+        printf("%" PRIu64 " %d %" PRIu64 " %" PRIu64 "\n", size, xmitter, end_usec - start_usec, rtt_nsec / n_rtt);
 }
 
 static void test_run_one(int fd, void *map, unsigned int xmitter, uint64_t times, uint64_t size) {
@@ -165,6 +487,11 @@ static void test_run_one(int fd, void *map, unsigned int xmitter, uint64_t times
 
         fprintf(stderr, "Run: times:%" PRIu64 " size:%" PRIu64 "\n", times, size);
 
+        if (xmitter >= C_ARRAY_SIZE(test_xmitters)) {
+                test_transport_run_one(xmitter, times, size);
+                return;
+        }
+
         /* do some test runs to initialize caches; don't account them */
         memset(map, 0, TEST_BUFSIZE);
         test_xmit(fd, map, xmitter, times / 10, size);
@@ -229,8 +556,9 @@ int main(int argc, char **argv) {
         }
 
         xmitter = atoi(argv[1]);
-        if (xmitter >= C_ARRAY_SIZE(test_xmitters)) {
-                fprintf(stderr, "Invalid xmitter (available: %zu)\n", C_ARRAY_SIZE(test_xmitters));
+        if (xmitter >= C_ARRAY_SIZE(test_xmitters) + C_ARRAY_SIZE(test_transports)) {
+                fprintf(stderr, "Invalid xmitter (available: %zu)\n",
+                        C_ARRAY_SIZE(test_xmitters) + C_ARRAY_SIZE(test_transports));
                 return 77;
         }
 
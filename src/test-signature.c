@@ -0,0 +1,190 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Compiled Signatures
+ *
+ * This verifies validation, layout and interning of compiled signatures, and
+ * that payloads written with them are identical to those written from plain
+ * strings. Messages are built on a peer detached from the kernel, so this
+ * does not require /dev/bus1.
+ */
+
+#undef NDEBUG
+#include <c-macro.h>
+#include <stdlib.h>
+#include <string.h>
+#include "message.h"
+#include "org.bus1/b1-peer.h"
+#include "peer.h"
+
+static void test_layout(const char *string, size_t alignment, size_t size) {
+        _c_cleanup_(b1_signature_unrefp) B1Signature *signature = NULL;
+        size_t n_string;
+        int r;
+
+        r = b1_signature_new(&signature, string);
+        assert(r >= 0);
+        assert(!strcmp(b1_signature_get_string(signature, &n_string), string));
+        assert(n_string == strlen(string));
+        assert(b1_signature_get_alignment(signature) == alignment);
+        assert(b1_signature_get_size(signature) == size);
+}
+
+static void test_invalid(const char *string) {
+        B1Signature *signature = NULL;
+        int r;
+
+        r = b1_signature_new(&signature, string);
+        assert(r == -EINVAL);
+        assert(!signature);
+}
+
+static void test_validate(void) {
+        char deep[2 * 128 + 2];
+
+        test_layout("", 1, 0);
+        test_layout("y", 1, 1);
+        test_layout("t", 8, 8);
+        test_layout("()", 1, 1);
+        test_layout("(tt)", 8, 16);
+        test_layout("(ty)", 8, 16);
+        test_layout("(yq)", 2, 4);
+        test_layout("(y(ty)b)", 8, 32);
+        test_layout("{ub}", 4, 8);
+        test_layout("yu", 4, 8);
+        test_layout("s", 1, 0);
+        test_layout("(ts)", 8, 0);
+        test_layout("a(su)", 4, 0);
+        test_layout("mt", 8, 0);
+        test_layout("v", 8, 0);
+        test_layout("a{sv}", 8, 0);
+
+        test_invalid("(");
+        test_invalid(")");
+        test_invalid("(t");
+        test_invalid("a");
+        test_invalid("m");
+        test_invalid("z");
+        test_invalid("{}");
+        test_invalid("{t}");
+        test_invalid("{tuu}");
+        test_invalid("{(t)u}");
+        test_invalid("t)");
+
+        memset(deep, 'a', sizeof(deep) - 2);
+        deep[sizeof(deep) - 2] = 't';
+        deep[sizeof(deep) - 1] = '\0';
+        test_invalid(deep);
+}
+
+static void test_intern(void) {
+        _c_cleanup_(b1_signature_unrefp) B1Signature *a = NULL, *b = NULL, *c = NULL;
+        int r;
+
+        r = b1_signature_new(&a, "(tu)");
+        assert(r >= 0);
+        r = b1_signature_new(&b, "(tu)");
+        assert(r >= 0);
+        r = b1_signature_new(&c, "(tuu)");
+        assert(r >= 0);
+
+        /* equal signatures are the same object, prefixes are not */
+        assert(a == b);
+        assert(a != c);
+}
+
+static size_t test_flatten(B1Message *message, uint8_t *buffer, size_t n_buffer) {
+        const struct iovec *vecs;
+        size_t n_vecs, n = 0;
+        int r;
+
+        r = b1_message_seal(message);
+        assert(r >= 0);
+
+        vecs = c_variant_get_vecs(message->data.cv, &n_vecs);
+        for (size_t i = 0; i < n_vecs; ++i) {
+                assert(n + vecs[i].iov_len <= n_buffer);
+                memcpy(buffer + n, vecs[i].iov_base, vecs[i].iov_len);
+                n += vecs[i].iov_len;
+        }
+
+        return n;
+}
+
+static void test_write(void) {
+        _c_cleanup_(b1_signature_unrefp) B1Signature *fixed = NULL, *dynamic = NULL, *unit = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *compiled = NULL, *plain = NULL;
+        uint8_t a[4096], b[4096];
+        uint64_t t = 0;
+        const char *s = NULL;
+        size_t n_a, n_b;
+        B1Peer *peer;
+        int r;
+
+        /* a detached peer, which owns messages but never talks to the kernel */
+        peer = calloc(1, sizeof(*peer));
+        assert(peer);
+        peer->n_ref = 1;
+
+        r = b1_signature_new(&fixed, "(y(tq)bd)");
+        assert(r >= 0);
+        r = b1_signature_new(&dynamic, "(ts)");
+        assert(r >= 0);
+        r = b1_signature_new(&unit, "()");
+        assert(r >= 0);
+
+        r = b1_message_new_call_signature(peer, &compiled, "org.bus1.Test", "Fixed", fixed, unit, NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_new_call(peer, &plain, "org.bus1.Test", "Fixed", "(y(tq)bd)", "()", NULL, NULL, NULL);
+        assert(r >= 0);
+
+        r = b1_message_write_signature(compiled, fixed, 7, UINT64_C(1) << 40, 3, true, 0.5);
+        assert(r >= 0);
+        r = b1_message_write(plain, "(y(tq)bd)", 7, UINT64_C(1) << 40, 3, true, 0.5);
+        assert(r >= 0);
+
+        n_a = test_flatten(compiled, a, sizeof(a));
+        n_b = test_flatten(plain, b, sizeof(b));
+        assert(n_a == n_b);
+        assert(!memcmp(a, b, n_a));
+
+        compiled = b1_message_unref(compiled);
+        plain = b1_message_unref(plain);
+
+        r = b1_message_new_call_signature(peer, &compiled, "org.bus1.Test", "Dynamic", dynamic, unit, NULL, NULL, NULL);
+        assert(r >= 0);
+        r = b1_message_write_signature(compiled, dynamic, UINT64_C(42), "foo");
+        assert(r >= 0);
+        r = b1_message_seal(compiled);
+        assert(r >= 0);
+        r = b1_message_read_signature(compiled, dynamic, &t, &s);
+        assert(r >= 0);
+        assert(t == 42);
+        assert(!strcmp(s, "foo"));
+
+        compiled = b1_message_unref(compiled);
+        b1_peer_unref(peer);
+}
+
+int main(int argc, char **argv) {
+        test_validate();
+        test_intern();
+        test_write();
+
+        return 0;
+}
@@ -0,0 +1,187 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Generated Stubs
+ *
+ * This verifies the stubs generated from test-stubgen.idl. Payloads written
+ * by the stubs must be identical to the ones written via b1_message_write(),
+ * which is checked on a peer detached from the kernel. If /dev/bus1 is
+ * available, a call is made through the generated client and server stubs.
+ */
+
+#undef NDEBUG
+#include <c-macro.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "message.h"
+#include "org.bus1/b1-peer.h"
+#include "peer.h"
+#include "test-stubgen-stubs.h"
+
+static uint64_t test_sum;
+
+int stubgen_add(B1Node *node, void *userdata, B1Message *message, uint64_t a0, uint64_t a1) {
+        return stubgen_add_reply(message, a0 + a1);
+}
+
+int stubgen_echo(B1Node *node, void *userdata, B1Message *message, uint64_t a0, const char *a1) {
+        return stubgen_echo_reply(message, a1);
+}
+
+int stubgen_nested(B1Node *node, void *userdata, B1Message *message, uint8_t a0, uint64_t a1, uint8_t a2, bool a3) {
+        return stubgen_nested_reply(message);
+}
+
+static int test_add_reply_fn(B1ReplySlot *slot, void *userdata, B1Message *message) {
+        return stubgen_add_read_reply(message, &test_sum);
+}
+
+static size_t test_flatten(B1Message *message, uint8_t *buffer, size_t n_buffer) {
+        const struct iovec *vecs;
+        size_t n_vecs, n = 0;
+
+        vecs = c_variant_get_vecs(message->data.cv, &n_vecs);
+        for (size_t i = 0; i < n_vecs; ++i) {
+                assert(n + vecs[i].iov_len <= n_buffer);
+                memcpy(buffer + n, vecs[i].iov_base, vecs[i].iov_len);
+                n += vecs[i].iov_len;
+        }
+
+        return n;
+}
+
+static void test_compare(B1Message *generated, B1Message *written) {
+        uint8_t a[4096], b[4096];
+        size_t n_a, n_b;
+        int r;
+
+        r = b1_message_seal(generated);
+        assert(r >= 0);
+        r = b1_message_seal(written);
+        assert(r >= 0);
+
+        n_a = test_flatten(generated, a, sizeof(a));
+        n_b = test_flatten(written, b, sizeof(b));
+        assert(n_a == n_b);
+        assert(!memcmp(a, b, n_a));
+}
+
+static B1Message *test_new_call(B1Peer *peer, const char *member, const char *signature) {
+        B1Message *message;
+        int r;
+
+        r = b1_message_new_call(peer, &message, "org.bus1.Stubgen", member, signature, "()", NULL, NULL, NULL);
+        assert(r >= 0);
+
+        return message;
+}
+
+static void test_layout(void) {
+        _c_cleanup_(b1_message_unrefp) B1Message *generated = NULL, *written = NULL;
+        B1Peer *peer;
+        uint64_t t1 = 0, t2 = 0;
+        uint8_t y1 = 0, y2 = 0;
+        bool b = false;
+        int r;
+
+        /* a detached peer, which owns messages but never talks to the kernel */
+        peer = calloc(1, sizeof(*peer));
+        assert(peer);
+        peer->n_ref = 1;
+
+        generated = test_new_call(peer, "Add", "(tt)");
+        written = test_new_call(peer, "Add", "(tt)");
+        r = stubgen_add_write(generated, UINT64_C(1) << 40, 7);
+        assert(r >= 0);
+        r = b1_message_write(written, "(tt)", UINT64_C(1) << 40, UINT64_C(7));
+        assert(r >= 0);
+        test_compare(generated, written);
+        r = stubgen_add_read(generated, &t1, &t2);
+        assert(r >= 0);
+        assert(t1 == UINT64_C(1) << 40);
+        assert(t2 == 7);
+
+        generated = b1_message_unref(generated);
+        written = b1_message_unref(written);
+
+        generated = test_new_call(peer, "Nested", "(y(ty)b)");
+        written = test_new_call(peer, "Nested", "(y(ty)b)");
+        r = stubgen_nested_write(generated, 1, 2, 3, true);
+        assert(r >= 0);
+        r = b1_message_write(written, "(y(ty)b)", 1, UINT64_C(2), 3, true);
+        assert(r >= 0);
+        test_compare(generated, written);
+        r = stubgen_nested_read(generated, &y1, &t1, &y2, &b);
+        assert(r >= 0);
+        assert(y1 == 1 && t1 == 2 && y2 == 3 && b);
+
+        generated = b1_message_unref(generated);
+        written = b1_message_unref(written);
+        b1_peer_unref(peer);
+}
+
+static void test_call(void) {
+        _c_cleanup_(b1_peer_unrefp) B1Peer *peer = NULL;
+        _c_cleanup_(b1_handle_unrefp) B1Handle *handle = NULL;
+        _c_cleanup_(b1_interface_unrefp) B1Interface *interface = NULL;
+        _c_cleanup_(b1_node_freep) B1Node *node = NULL;
+        _c_cleanup_(b1_reply_slot_freep) B1ReplySlot *slot = NULL;
+        _c_cleanup_(b1_message_unrefp) B1Message *request = NULL, *reply = NULL;
+        B1Peer *clone;
+        int r;
+
+        r = stubgen_interface_new(&interface);
+        assert(r >= 0);
+
+        r = b1_peer_new(&peer, NULL);
+        assert(r >= 0);
+        r = b1_peer_clone(peer, &node, &handle);
+        assert(r >= 0);
+        clone = b1_node_get_peer(node);
+
+        r = b1_node_implement(node, interface);
+        assert(r >= 0);
+
+        r = stubgen_add_call(peer, handle, 40, 2, &slot, test_add_reply_fn, NULL);
+        assert(r >= 0);
+
+        r = b1_peer_recv(clone, &request);
+        assert(r >= 0);
+        r = b1_message_dispatch(request);
+        assert(r >= 0);
+
+        r = b1_peer_recv(peer, &reply);
+        assert(r >= 0);
+        r = b1_message_dispatch(reply);
+        assert(r >= 0);
+
+        assert(test_sum == 42);
+}
+
+int main(int argc, char **argv) {
+        test_layout();
+
+        if (access("/dev/bus1", F_OK) < 0 && errno == ENOENT)
+                return 0;
+
+        test_call();
+
+        return 0;
+}
@@ -0,0 +1,28 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Semaphores of the probes declared in trace.h. They live in the .probes
+ * section, where tracers find and increment them while attached.
+ */
+
+#include "trace.h"
+
+#ifdef HAVE_SYS_SDT_H
+#  define B1_TRACE_DEFINE(name) unsigned short B1_TRACE_SEMAPHORE(name) __attribute__((section(".probes")));
+B1_TRACE_PROBES(B1_TRACE_DEFINE)
+#endif
@@ -0,0 +1,69 @@
+/***
+  This file is part of bus1. See COPYING for details.
+
+  bus1 is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  bus1 is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with bus1; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/*
+ * Static tracepoints
+ *
+ * B1_TRACE() places a USDT probe named @name in the "libbus1" provider, which
+ * can be attached to with perf, bpftrace or systemtap. A disabled probe is a
+ * single nop, but its arguments are still evaluated, so only pass values that
+ * are at hand anyway. Arguments that are expensive to compute must be guarded
+ * by B1_TRACE_ENABLED(), which reads the semaphore tracers increment while
+ * attached to the probe. Without <sys/sdt.h>, probes compile to nothing.
+ *
+ * Probes:
+ *   send_entry(message, type, n_destinations)
+ *   send_exit(message, r, n_bytes)
+ *   recv(message, type, n_bytes, n_handles, n_fds, destination)
+ *   recv_node_destroy(handle_id)
+ *   dispatch_entry(node_id, interface, member)
+ *   dispatch_exit(node_id, r)
+ *   reply_entry(node_id, type)
+ *   reply_exit(node_id, r)
+ *   slice_release(offset, n_bytes)
+ *   handle_release(handle_id)
+ *   node_destroy(node_id)
+ */
+
+#define B1_TRACE_PROBES(X)              \
+        X(send_entry)                   \
+        X(send_exit)                    \
+        X(recv)                         \
+        X(recv_node_destroy)            \
+        X(dispatch_entry)               \
+        X(dispatch_exit)                \
+        X(reply_entry)                  \
+        X(reply_exit)                   \
+        X(slice_release)                \
+        X(handle_release)               \
+        X(node_destroy)
+
+#ifdef HAVE_SYS_SDT_H
+#  define _SDT_HAS_SEMAPHORES 1
+#  include <sys/sdt.h>
+#  define B1_TRACE_SEMAPHORE(name) libbus1_##name##_semaphore
+#  define B1_TRACE_DECLARE(name) extern unsigned short B1_TRACE_SEMAPHORE(name);
+B1_TRACE_PROBES(B1_TRACE_DECLARE)
+#  define B1_TRACE(name, ...) STAP_PROBEV(libbus1, name, ##__VA_ARGS__)
+#  define B1_TRACE_ENABLED(name) __builtin_expect(B1_TRACE_SEMAPHORE(name) != 0, 0)
+#else
+#  define B1_TRACE_ENABLED(name) (0)
+/* keep the arguments referenced, so disabling probes does not cause warnings */
+static inline void b1_trace_nop(int unused, ...) {
+}
+#  define B1_TRACE(name, ...) do { if (0) b1_trace_nop(0, ##__VA_ARGS__); } while (0)
+#endif